@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+
+#include "ev3cxx.h"
+#include "PeriodicLoop.h"
+
+
+// Runs a motor against an end stop without blocking the caller. The control task
+// posts a move with move() and the actuator task executes it in update(); the move
+// ends when the encoder stalls (the mechanism hit its end stop) or on timeout, then
+// the motor is braked.
+// The tasks share only sequence numbers written by a single side each, so no atomic
+// read-modify-write is needed.
+class Actuator
+{
+public:
+	Actuator( ev3cxx::Motor& motor, int stallDeg = 3, uint32_t stallMs = 80, uint32_t minMs = 100 )
+			: _motor( motor ), _stallDeg( stallDeg ), _stallUs( stallMs * 1000 ), _minUs( minMs * 1000 ),
+			  _speed( 0 ), _timeoutUs( 0 ), _requested( 0 ), _finished( 0 ), _served( 0 ),
+			  _startUs( 0 ), _lastMoveUs( 0 ), _lastPos( 0 ), _stalled( false ) { }
+
+
+	// Control task: starts a move; a new move replaces an unfinished one
+	void move( int speed, uint32_t timeoutMs )
+	{
+		_speed = speed;
+		_timeoutUs = timeoutMs * 1000;
+		_requested.store( _requested.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+	}
+
+
+	// Control task: brakes the motor
+	void stop( )
+	{
+		move( 0, 0 );
+	}
+
+
+	bool busy( ) const
+	{
+		return _finished.load( std::memory_order_acquire ) != _requested.load( std::memory_order_acquire );
+	}
+
+
+	void wait( )
+	{
+		while ( busy() )
+			ev3cxx::delayMs( 5 );
+	}
+
+
+	// True if the last move ended on the end stop rather than on timeout
+	bool stalled( ) const
+	{
+		return _stalled;
+	}
+
+
+	// Actuator task
+	void update( )
+	{
+		uint32_t now = nowUs();
+		uint32_t requested = _requested.load( std::memory_order_acquire );
+		if ( requested != _served ) {
+			_served = requested;
+			_startUs = now;
+			_lastMoveUs = now;
+			_lastPos = _motor.degrees();
+			_stalled = false;
+			if ( _speed == 0 ) {
+				finish( false );
+				return;
+			}
+			_motor.on( _speed );
+			return;
+		}
+		if ( _finished.load( std::memory_order_relaxed ) == _served )
+			return;
+
+		int pos = _motor.degrees();
+		if ( std::abs( pos - _lastPos ) >= _stallDeg ) {
+			_lastPos = pos;
+			_lastMoveUs = now;
+		}
+		bool stall = now - _startUs >= _minUs && now - _lastMoveUs >= _stallUs;
+		if ( stall || now - _startUs >= _timeoutUs )
+			finish( stall );
+	}
+
+
+private:
+	void finish( bool stall )
+	{
+		_motor.off( true );
+		_stalled = stall;
+		_finished.store( _served, std::memory_order_release );
+	}
+
+
+	ev3cxx::Motor& _motor;
+	int _stallDeg;
+	uint32_t _stallUs;
+	uint32_t _minUs;
+
+	// written by the control task
+	int _speed;
+	uint32_t _timeoutUs;
+	std::atomic < uint32_t > _requested;
+	// written by the actuator task
+	std::atomic < uint32_t > _finished;
+	uint32_t _served;
+	uint32_t _startUs;
+	uint32_t _lastMoveUs;
+	int _lastPos;
+	bool _stalled;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+
+#include <atoms/communication/avakar.h>
+
+#include "ev3cxx.h"
+#include "Parameters.h"
+#include "TelemetrySchema.h"
+
+
+// Inbound Avakar commands from Bluetooth (see cmd:: in TelemetrySchema.h). The
+// command task blocks in receive(); parameter changes are handed over to the
+// ParameterRegistry and take effect at its next apply().
+class CommandChannel
+{
+public:
+	CommandChannel( ParameterRegistry& parameters )
+			: _parameters( parameters ), _in( nullptr ), _commands( 0 ), _rejected( 0 ) { }
+
+
+	// Its own FILE for reading, Telemetry writes to the port through another one
+	void open( )
+	{
+		_in = ev3_serial_open_file( EV3_SERIAL_BT );
+	}
+
+
+	// Command task; reads and handles one byte, returns false if there is nothing
+	// to read from
+	bool receive( )
+	{
+		if ( !_in || !ev3_bluetooth_is_connected() )
+			return false;
+		int c = std::fgetc( _in );
+		if ( c == EOF ) {
+			std::clearerr( _in );
+			return false;
+		}
+		if ( _packet.push_byte( static_cast< uint8_t >( c ) ) ) {
+			handle( _packet.raw(), _packet.raw_size() );
+			_packet.clear();
+		}
+		return true;
+	}
+
+
+	// A complete Avakar packet
+	void handle( const uint8_t* frame, size_t size )
+	{
+		uint8_t id;
+		int32_t value;
+		bool ok;
+		if ( cmd::SetParameter::decode( frame, size, id, value ) )
+			ok = _parameters.request( id, value );
+		else if ( cmd::GetParameter::decode( frame, size, id ) )
+			ok = _parameters.requestReport( id );
+		else
+			ok = false;
+		_commands.store( _commands.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+		if ( !ok )
+			_rejected.store( _rejected.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	}
+
+
+	uint32_t commandCount( ) const
+	{
+		return _commands.load( std::memory_order_relaxed );
+	}
+
+
+	uint32_t rejectedCount( ) const
+	{
+		return _rejected.load( std::memory_order_relaxed );
+	}
+
+
+private:
+	ParameterRegistry& _parameters;
+	FILE* _in;
+	atoms::AvakarPacketU _packet;
+	// written by the command task only
+	std::atomic < uint32_t > _commands;
+	std::atomic < uint32_t > _rejected;
+};
@@ -1,98 +1,132 @@
-
 #pragma once
 
-template < typename T >
-struct Approximately {
-    T _bottom, _up;
-};
-
-template < typename T >
-bool operator==( T val, Approximately< T > ap ) {
-    return val > ap._bottom && val < ap._up;
-}
-
-template < typename T >
-bool operator!=( T val, Approximately< T > ap ) {
-    return val < ap._bottom || val > ap._up;
-}
+#include <cstdint>
+#include <limits>
+#include <algorithm>
 
-template < typename T >
-Approximately< T > approximately( T val, T tolerance ) {
-    return { val - tolerance, val + tolerance };
-}
+#include <atoms/numeric/filter.h>
 
 #include "ev3cxx.h"
+#include "Sonar.h"
 
+// Opponent detection from the sonar readings. Every sensor is median filtered, the
+// closing speed is estimated from the rate of the filtered distance and the robot
+// brakes when the time to collision gets short, or when something is closer than
+// stopCm regardless of its speed. Only consecutive distances in range give a rate,
+// so an object which merely comes into range does not look like it approaches.
 class Detector
 {
     public:
-        Detector(ev3cxx::UltrasonicSensor& topSensor, ev3cxx::UltrasonicSensor& sideSensor, int trashold, int collision): topSensor(topSensor), sideSensor(sideSensor){
-            this->trashold = trashold;
-            this->collision = collision;
-        }
+        struct Config {
+            int stopCm;    // always brake below this distance
+            int brakeMs;   // brake when the collision is nearer than this
+            int rangeCm;   // ignore everything further away
+            int maxClosingCmPerS;   // faster changes are sonar glitches
+        };
 
         enum State {
             Clear = 0,
             Enemy,
-            Unsure,
-            Messure
+            Unsure,        // something in range, but not approaching fast enough
+            NoData         // all sensors are stale
         };
 
-        State detect()
+        static const int MEDIAN = 3;
+
+        Detector(SonarService& sonar, Config config = { 10, 700, 80, 300 })
+            : sonar(sonar), config(config), state(NoData), distance(255), closing(0)
         {
-            int top = topSensor.centimeters();
-            int side = topSensor.centimeters();
+            for (Channel& c : channels)
+                c.rate = atoms::RateEstimator<2>(config.maxClosingCmPerS);
+        }
 
-            if (top > collision && side > collision){
-                return State::Clear;
+        // Processes new pings; cheap when there are none, call it every tick
+        State update()
+        {
+            int nearest = -1;
+            for (int i = 0; i != sonar.sensorCount(); i++) {
+                Channel& c = channels[i];
+                SonarReading r = sonar.read(i);
+                if (r.stale) {
+                    // start over, the rate across the gap would be meaningless
+                    c.valid = false;
+                    continue;
+                }
+                if (!c.valid || r.timeUs != c.timeUs)
+                    push(c, r);
+                if (nearest == -1 || c.median.get() < channels[nearest].median.get())
+                    nearest = i;
             }
 
-            if (top < collision && side < collision){
-                return State::Enemy;
+            if (nearest == -1) {
+                state = NoData;
+                return state;
             }
-
-            lastDistanceTop = top;
-            lastDistanceSide = side;
-
-            return State::Unsure;
+            distance = channels[nearest].median.get();
+            closing = -channels[nearest].rate.get();
+            if (distance > config.rangeCm)
+                state = Clear;
+            else if (distance <= config.stopCm || ttcMs() < config.brakeMs)
+                state = Enemy;
+            else
+                state = Unsure;
+            return state;
         }
 
-        State reDetect()
+        State detect() const
         {
-            if (lastDistanceTop == -1){
-                return State::Messure;
-            }
+            return state;
+        }
 
-            int top = topSensor.centimeters();
-            int side = topSensor.centimeters();
-            
-            return State::Clear;
+        int distanceCm() const
+        {
+            return distance;
+        }
 
-            if (top > collision && side > collision){
-                return State::Clear;
-            }
+        // Positive when the opponent gets closer
+        int closingCmPerS() const
+        {
+            return closing;
+        }
 
-            if (top < collision && side < collision){
-                return State::Enemy;
-            }
+        // Time until the opponent reaches stopCm, max int when it does not approach
+        int ttcMs() const
+        {
+            if (closing <= 0)
+                return std::numeric_limits<int>::max();
+            return std::max(0, distance - config.stopCm) * 1000 / closing;
+        }
 
-            if (lastDistanceTop != approximately(top, trashold) || lastDistanceSide != approximately(side, trashold)){
-                lastDistanceTop = top;
-                lastDistanceSide = side;
+    private:
+        struct Channel {
+            Channel() : median(255), timeUs(0), valid(false) {}
+
+            atoms::MedianFilter<int, MEDIAN> median;
+            // of the median distance, negative when the opponent gets closer
+            atoms::RateEstimator<2> rate;
+            uint32_t timeUs;
+            bool valid;
+        };
 
-                return State::Enemy;
+        void push(Channel& c, const SonarReading& r)
+        {
+            if (!c.valid) {
+                c.median.reset(r.cm);
+                c.rate.reset();
             }
-
-            return State::Clear;
+            else
+                c.median.push(r.cm);
+            int now = c.median.get();
+            c.rate.push(now, r.timeUs, now <= config.rangeCm && now < 255);
+            c.timeUs = r.timeUs;
+            c.valid = true;
         }
 
-    private:
-        int lastDistanceTop = -1;
-        int lastDistanceSide = -1;
-
-        int collision = 0;
-        int trashold = 0;
+        SonarService& sonar;
+        Config config;
+        Channel channels[SonarService::MAX_SENSORS];
 
-        ev3cxx::UltrasonicSensor topSensor;
-        ev3cxx::UltrasonicSensor sideSensor;
+        State state;
+        int distance;
+        int closing;
 };
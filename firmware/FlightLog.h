@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Format of the flight recorder dump, shared with the host decoder in tools/. The
+// file is a FlightLogHeader followed by FlightLogHeader::count events, oldest first,
+// all little endian.
+
+enum class FlightEventType : uint8_t
+{
+	Sensor = 1,  // arg: touch; v: colorL, colorR, encoderL, encoderR (low 16 bits)
+	Motors,      // arg: 0 on, 1 off, 2 brake; v: both arguments of MotorTank::on(), the first
+	             // drives the physical right wheel
+	Primitive,   // arg: FlightPrimitive; v[ 0 ]: Robot::State result, or -1 at the start
+	             // followed by the arguments of the primitive
+	Plan,        // arg: Pred of the next move; v: x, y, target x, target y, reverse
+	Detector,    // arg: Detector::State it changed to; v: distance cm, closing cm/s
+	Exit,        // arg: exit code
+	Sonar,       // arg: sensor; v[ 0 ]: distance cm; the time of the ping
+	Pose,        // odometry corrected by the planner; v: x mm, y mm, heading >> 16,
+	             // 1 = position and 2 = heading corrected
+	Parameter,   // arg: ParameterRegistry id; v: value low and high 16 bits
+};
+
+
+enum class FlightPrimitive : uint8_t
+{
+	Step = 1,
+	StepBackward,
+	MoveForward,
+	MoveBackward,
+	Rotate,
+	ArcTurn,
+	FindLine,
+	Calibrate,
+};
+
+
+struct FlightEvent
+{
+	uint32_t timeUs;
+	uint8_t type;
+	uint8_t arg;
+	int16_t v[ 5 ];
+};
+
+
+struct FlightLogHeader
+{
+	char magic[ 4 ];    // "KFLT"
+	uint8_t version;
+	uint8_t eventSize;
+	uint16_t reserved;
+	uint32_t recorded;  // events recorded since the start, including the overwritten ones
+	uint32_t count;     // events in the file
+};
+
+
+static const uint8_t FLIGHT_LOG_VERSION = 1;
+
+static_assert( sizeof( FlightEvent ) == 16, "FlightEvent is a part of the file format" );
+static_assert( sizeof( FlightLogHeader ) == 16, "FlightLogHeader is a part of the file format" );
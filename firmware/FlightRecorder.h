@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "ev3cxx.h"
+#include "PeriodicLoop.h"
+#include "Sensors.h"
+#include "FlightLog.h"
+
+
+// Always-on record of the last CAPACITY events of the robot, dumped to the SD card
+// when the program ends, so that a failed run can be examined afterwards with
+// tools/flightlog. Recording is a timestamp and a 16 byte store into a ring which
+// overwrites the oldest events; there are no locks, so only one task may record at
+// a time (the main task, or a startup task while the main task waits for it).
+class FlightRecorder
+{
+public:
+	// 256 kB, about 20 s of line following
+	static const uint32_t CAPACITY = 16384;
+
+
+	FlightRecorder( )
+			: _recorded( 0 ) { }
+
+
+	void record( FlightEventType type, uint8_t arg, int16_t v0 = 0, int16_t v1 = 0, int16_t v2 = 0,
+	             int16_t v3 = 0, int16_t v4 = 0 )
+	{
+		recordAt( nowUs(), type, arg, v0, v1, v2, v3, v4 );
+	}
+
+
+	void recordAt( uint32_t timeUs, FlightEventType type, uint8_t arg, int16_t v0 = 0, int16_t v1 = 0,
+	               int16_t v2 = 0, int16_t v3 = 0, int16_t v4 = 0 )
+	{
+		FlightEvent& e = _events[ _recorded & ( CAPACITY - 1 ) ];
+		e.timeUs = timeUs;
+		e.type = static_cast< uint8_t >( type );
+		e.arg = arg;
+		e.v[ 0 ] = v0;
+		e.v[ 1 ] = v1;
+		e.v[ 2 ] = v2;
+		e.v[ 3 ] = v3;
+		e.v[ 4 ] = v4;
+		_recorded++;
+	}
+
+
+	void sensors( const SensorFrame& f )
+	{
+		recordAt( f.timeUs, FlightEventType::Sensor, f.touch, f.colorL, f.colorR,
+		          static_cast< int16_t >( f.encoderL ), static_cast< int16_t >( f.encoderR ) );
+	}
+
+
+	void motors( int a, int b )
+	{
+		record( FlightEventType::Motors, 0, a, b );
+	}
+
+
+	// Start of a primitive with its arguments, enough to call it again in a replay
+	void begin( FlightPrimitive p, int16_t a0 = 0, int16_t a1 = 0 )
+	{
+		record( FlightEventType::Primitive, static_cast< uint8_t >( p ), -1, a0, a1 );
+	}
+
+
+	template < typename State >
+	State end( FlightPrimitive p, State result )
+	{
+		record( FlightEventType::Primitive, static_cast< uint8_t >( p ), static_cast< int16_t >( result ) );
+		return result;
+	}
+
+
+	// Writes the events oldest first; the recording continues afterwards
+	bool dump( const char* path ) const
+	{
+		uint32_t recorded = _recorded;
+		uint32_t count = recorded < CAPACITY ? recorded : CAPACITY;
+		uint32_t first = ( recorded - count ) & ( CAPACITY - 1 );
+
+		FlightLogHeader h;
+		std::memset( &h, 0, sizeof( h ) );
+		std::memcpy( h.magic, "KFLT", 4 );
+		h.version = FLIGHT_LOG_VERSION;
+		h.eventSize = sizeof( FlightEvent );
+		h.recorded = recorded;
+		h.count = count;
+
+		FILE* file = std::fopen( path, "wb" );
+		if ( !file )
+			return false;
+		uint32_t tail = std::min( count, CAPACITY - first );
+		bool ok = std::fwrite( &h, sizeof( h ), 1, file ) == 1 &&
+		          std::fwrite( _events + first, sizeof( FlightEvent ), tail, file ) == tail &&
+		          std::fwrite( _events, sizeof( FlightEvent ), count - tail, file ) == count - tail;
+		return std::fclose( file ) == 0 && ok;
+	}
+
+
+	uint32_t recorded( ) const
+	{
+		return _recorded;
+	}
+
+
+private:
+	static_assert( ( CAPACITY & ( CAPACITY - 1 ) ) == 0, "CAPACITY has to be a power of two" );
+
+	FlightEvent _events[ CAPACITY ];
+	uint32_t _recorded;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+
+// Integer square root, rounds down
+inline uint32_t isqrt( uint32_t v )
+{
+	uint32_t res = 0;
+	uint32_t bit = uint32_t( 1 ) << 30;
+	while ( bit > v )
+		bit >>= 2;
+	while ( bit ) {
+		if ( v >= res + bit ) {
+			v -= res + bit;
+			res = ( res >> 1 ) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return res;
+}
+
+
+// Trapezoidal velocity profile driven by the remaining encoder distance. Speeds are
+// motor powers in percent; one call of speed() corresponds to one control tick.
+// The speed rises by accel per tick up to maxSpeed and is limited so that the robot
+// can slow down to minSpeed by the target with decel per tick:
+//     v^2 <= minSpeed^2 + 2 * decel * remaining * 100 / degPerTick
+// where degPerTick is the encoder travel per tick at full power.
+class MotionProfile
+{
+public:
+	struct Config
+	{
+		int minSpeed;
+		int maxSpeed;
+		int accel;
+		int decel;
+		int degPerTick;
+	};
+
+
+	MotionProfile( const Config& config )
+			: _config( config ), _distance( 0 ), _speed( 0 ) { }
+
+
+	void start( int distanceDeg, int startSpeed = -1 )
+	{
+		_distance = std::abs( distanceDeg );
+		_speed = startSpeed < 0 ? _config.minSpeed : startSpeed;
+	}
+
+
+	// Speed set-point (always positive) for the given travelled encoder distance
+	int speed( int travelledDeg )
+	{
+		int remaining = std::max( 0, _distance - std::abs( travelledDeg ) );
+		uint32_t braking = uint32_t( _config.minSpeed * _config.minSpeed ) +
+		                   uint32_t( 2 * _config.decel ) * remaining * 100 / _config.degPerTick;
+		int limit = std::min( _config.maxSpeed, static_cast< int >( isqrt( braking ) ) );
+
+		if ( _speed < limit )
+			_speed = std::min( limit, _speed + _config.accel );
+		else
+			_speed = std::max( limit, _speed - _config.decel );
+		_speed = std::max( _speed, _config.minSpeed );
+		return _speed;
+	}
+
+
+	bool done( int travelledDeg ) const
+	{
+		return std::abs( travelledDeg ) >= _distance;
+	}
+
+
+	const Config& config( ) const
+	{
+		return _config;
+	}
+
+
+	void setConfig( const Config& config )
+	{
+		_config = config;
+	}
+
+
+private:
+	Config _config;
+	int _distance;
+	int _speed;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+#include "RobotGeometry.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+// Binary angle: the full turn is 2^32, so the arithmetic wraps for free.
+// 0 is North (+y), angles grow counter-clockwise like Pred (North, West, South, East).
+using Angle = uint32_t;
+
+static const Angle QUARTER_TURN = Angle( 1 ) << 30;
+
+
+// sin() of a binary angle in Q15, quarter-wave table with linear interpolation
+inline int32_t sinQ15( Angle a )
+{
+	static const int16_t table[ 65 ] = {
+		0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+		12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+		23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+		30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+		32767
+	};
+
+	uint32_t quadrant = a >> 30;
+	uint32_t inQuadrant = a & ( QUARTER_TURN - 1 );
+	if ( quadrant & 1 )
+		inQuadrant = QUARTER_TURN - 1 - inQuadrant;
+	uint32_t idx = inQuadrant >> 24;
+	int32_t frac = ( inQuadrant >> 16 ) & 0xFF;
+	int32_t v = table[ idx ] + ( ( ( table[ idx + 1 ] - table[ idx ] ) * frac ) >> 8 );
+	return quadrant & 2 ? -v : v;
+}
+
+
+inline int32_t cosQ15( Angle a )
+{
+	return sinQ15( a + QUARTER_TURN );
+}
+
+
+// Dead reckoning from the wheel encoders. Positions are kept in micrometers and the
+// heading as a binary angle, so the integration runs without floating point; the
+// geometry dependent factors are computed only when the geometry is set.
+class Odometry
+{
+public:
+	Odometry( RobotGeometry& geometry )
+			: _x( 0 ), _y( 0 ), _heading( 0 ), _lastL( 0 ), _lastR( 0 ), _initialized( false )
+	{
+		setGeometry( geometry );
+	}
+
+
+	// Keeps the pose, only the following updates use the new geometry
+	void setGeometry( RobotGeometry& geometry )
+	{
+		double mmPerDeg = geometry.wheelDiameter() * M_PI / 360;
+		// both wheels summed, so half of the distance per degree; Q8
+		_umPerDegSumQ8 = static_cast< int32_t >( mmPerDeg * 1000 / 2 * 256 + 0.5 );
+		// heading change per degree of wheel difference
+		_anglePerDegDiff = static_cast< int32_t >( mmPerDeg / geometry.wheelBase() / ( 2 * M_PI ) * 4294967296.0 + 0.5 );
+	}
+
+
+	void reset( int32_t xMm, int32_t yMm, Angle heading )
+	{
+		_x = xMm * 1000;
+		_y = yMm * 1000;
+		_heading = heading;
+	}
+
+
+	// Integrates absolute encoder readings of the physical left and right wheel
+	void update( int32_t encoderL, int32_t encoderR )
+	{
+		if ( !_initialized ) {
+			_lastL = encoderL;
+			_lastR = encoderR;
+			_initialized = true;
+			return;
+		}
+		int32_t dL = encoderL - _lastL;
+		int32_t dR = encoderR - _lastR;
+		_lastL = encoderL;
+		_lastR = encoderR;
+		if ( dL == 0 && dR == 0 )
+			return;
+
+		// 64 bit products, frames may be dropped while the control loop is blocked
+		int32_t distance = static_cast< int32_t >( ( int64_t( dL + dR ) * _umPerDegSumQ8 ) >> 8 );
+		Angle turn = static_cast< Angle >( int64_t( dR - dL ) * _anglePerDegDiff );
+		Angle mid = _heading + static_cast< Angle >( static_cast< int32_t >( turn ) / 2 );
+
+		_x -= static_cast< int32_t >( ( int64_t( distance ) * sinQ15( mid ) ) >> 15 );
+		_y += static_cast< int32_t >( ( int64_t( distance ) * cosQ15( mid ) ) >> 15 );
+		_heading += turn;
+	}
+
+
+	// Known position, e.g. when the line sensors cross an intersection
+	void correctPosition( int32_t xMm, int32_t yMm )
+	{
+		_x = xMm * 1000;
+		_y = yMm * 1000;
+	}
+
+
+	// Known heading, e.g. while following a line
+	void correctHeading( Angle heading )
+	{
+		_heading = heading;
+	}
+
+
+	int32_t xMm( ) const
+	{
+		return _x / 1000;
+	}
+
+
+	int32_t yMm( ) const
+	{
+		return _y / 1000;
+	}
+
+
+	Angle heading( ) const
+	{
+		return _heading;
+	}
+
+
+	// Heading in degrees, 0 - 359
+	int headingDeg( ) const
+	{
+		return static_cast< int >( ( uint64_t( _heading ) * 360 ) >> 32 );
+	}
+
+
+private:
+	int32_t _x, _y;
+	Angle _heading;
+	int32_t _lastL, _lastR;
+	bool _initialized;
+
+	int32_t _umPerDegSumQ8;
+	int32_t _anglePerDegDiff;
+};
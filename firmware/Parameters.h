@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <functional>
+
+
+// Integer parameters of the control code which can be tuned while the robot runs.
+// Requests come from the command task and are only stored; the control code writes
+// them to the parameters with apply() at a point where a change cannot disturb a
+// running primitive. The command task is the only writer of the request fields and
+// apply() only reads them, so there is no locking and no atomic read-modify-write,
+// which the EV3 CPU does not have.
+class ParameterRegistry
+{
+public:
+	static const int CAPACITY = 16;
+	// requestReport() of every parameter
+	static const uint8_t ALL = 0xFF;
+
+
+	ParameterRegistry( )
+			: _count( 0 ) { }
+
+
+	// Control code, before the command task starts. Ids are given by the order of
+	// registration; changed is called after apply() or set() writes a new value.
+	void add( const char* name, int& value, int min, int max, std::function < void( ) > changed = nullptr )
+	{
+		if ( _count == CAPACITY )
+			return;
+		Entry& e = _entries[ _count++ ];
+		e.name = name;
+		e.value = &value;
+		e.min = min;
+		e.max = max;
+		e.changed = changed;
+	}
+
+
+	// Command task; returns false for an unknown id or a value out of range. The
+	// value is reported back by the next apply() either way.
+	bool request( uint8_t id, int32_t value )
+	{
+		if ( id >= _count )
+			return false;
+		Entry& e = _entries[ id ];
+		if ( value < e.min || value > e.max ) {
+			bump( e.reportSeq );
+			return false;
+		}
+		e.requested.store( value, std::memory_order_relaxed );
+		bump( e.setSeq );
+		return true;
+	}
+
+
+	// Command task; the value is reported by the next apply()
+	bool requestReport( uint8_t id )
+	{
+		if ( id == ALL ) {
+			for ( int i = 0; i != _count; i++ )
+				bump( _entries[ i ].reportSeq );
+			return true;
+		}
+		if ( id >= _count )
+			return false;
+		bump( _entries[ id ].reportSeq );
+		return true;
+	}
+
+
+	// Control code at a safe point; writes the requested values and calls
+	// report( id, value, changed ) for every written or asked for parameter
+	template < typename Report >
+	void apply( Report report )
+	{
+		for ( int i = 0; i != _count; i++ ) {
+			Entry& e = _entries[ i ];
+			uint32_t setSeq = e.setSeq.load( std::memory_order_acquire );
+			uint32_t reportSeq = e.reportSeq.load( std::memory_order_acquire );
+			bool changed = setSeq != e.appliedSeq;
+			if ( changed ) {
+				e.appliedSeq = setSeq;
+				write( e, e.requested.load( std::memory_order_relaxed ) );
+			}
+			if ( changed || reportSeq != e.reportedSeq ) {
+				e.reportedSeq = reportSeq;
+				report( uint8_t( i ), int32_t( *e.value ), changed );
+			}
+		}
+	}
+
+
+	// Control code; writes the value at once, e.g. in the replay
+	bool set( uint8_t id, int32_t value )
+	{
+		if ( id >= _count || value < _entries[ id ].min || value > _entries[ id ].max )
+			return false;
+		write( _entries[ id ], value );
+		return true;
+	}
+
+
+	int count( ) const
+	{
+		return _count;
+	}
+
+
+	const char* name( uint8_t id ) const
+	{
+		return id < _count ? _entries[ id ].name : nullptr;
+	}
+
+
+	// -1 if there is no such parameter
+	int find( const char* name ) const
+	{
+		for ( int i = 0; i != _count; i++ )
+			if ( std::strcmp( _entries[ i ].name, name ) == 0 )
+				return i;
+		return -1;
+	}
+
+
+private:
+	struct Entry
+	{
+		const char* name = nullptr;
+		int* value = nullptr;
+		int min = 0;
+		int max = 0;
+		std::function < void( ) > changed;
+		// written by the command task only
+		std::atomic < int32_t > requested{ 0 };
+		std::atomic < uint32_t > setSeq{ 0 };
+		std::atomic < uint32_t > reportSeq{ 0 };
+		// control code only
+		uint32_t appliedSeq = 0;
+		uint32_t reportedSeq = 0;
+	};
+
+
+	// Single writer, so a load and a store is enough
+	static void bump( std::atomic < uint32_t >& seq )
+	{
+		seq.store( seq.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+	}
+
+
+	static void write( Entry& e, int32_t value )
+	{
+		*e.value = value;
+		if ( e.changed )
+			e.changed();
+	}
+
+
+	Entry _entries[ CAPACITY ];
+	int _count;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "ev3cxx.h"
+
+
+// Microsecond timestamp from the kernel performance counter; wraps after ~71 minutes,
+// so always compare timestamps by unsigned difference
+inline uint32_t nowUs( )
+{
+	SYSUTM t;
+	get_utm( &t );
+	return static_cast< uint32_t >( t );
+}
+
+
+struct LoopStats
+{
+	LoopStats( ) { clear(); }
+
+
+	void clear( )
+	{
+		iterations = 0;
+		overruns = 0;
+		execLastUs = 0;
+		execMaxUs = 0;
+		execSumUs = 0;
+		jitterMaxUs = 0;
+		jitterSumUs = 0;
+	}
+
+
+	uint32_t execAvgUs( ) const
+	{
+		return iterations ? static_cast< uint32_t >( execSumUs / iterations ) : 0;
+	}
+
+
+	uint32_t jitterAvgUs( ) const
+	{
+		return iterations > 1 ? static_cast< uint32_t >( jitterSumUs / ( iterations - 1 ) ) : 0;
+	}
+
+
+	uint32_t iterations;
+	uint32_t overruns;     // ticks which did not finish before the next deadline
+	uint32_t execLastUs;   // time spent inside the tick callback
+	uint32_t execMaxUs;
+	uint64_t execSumUs;
+	uint32_t jitterMaxUs;  // |measured period - nominal period|
+	uint64_t jitterSumUs;
+};
+
+
+// Runs a tick callback at a fixed rate. Deadlines are absolute (start + k * period),
+// so the time spent in the callback and in sensor reads does not stretch the period.
+// The kernel sleeps with 1 ms resolution, so a tick may start up to 1 ms late but never
+// early; the residual error is visible in the stats.
+class PeriodicLoop
+{
+public:
+	PeriodicLoop( uint32_t periodUs )
+			: _periodUs( periodUs ) { }
+
+
+	// Calls tick() every period until it returns false
+	template < typename Tick >
+	void run( Tick tick )
+	{
+		uint32_t deadline = nowUs();
+		uint32_t lastStart = deadline;
+		bool first = true;
+		while ( true ) {
+			uint32_t start = nowUs();
+			if ( !first ) {
+				uint32_t jitter = std::abs( static_cast< int32_t >( start - lastStart - _periodUs ) );
+				if ( jitter > _stats.jitterMaxUs )
+					_stats.jitterMaxUs = jitter;
+				_stats.jitterSumUs += jitter;
+			}
+			first = false;
+			lastStart = start;
+
+			bool running = tick();
+
+			uint32_t exec = nowUs() - start;
+			_stats.iterations++;
+			_stats.execLastUs = exec;
+			_stats.execSumUs += exec;
+			if ( exec > _stats.execMaxUs )
+				_stats.execMaxUs = exec;
+
+			if ( !running )
+				return;
+
+			deadline += _periodUs;
+			if ( static_cast< int32_t >( deadline - nowUs() ) <= 0 ) {
+				// Do not try to catch up with a burst of ticks, restart the schedule
+				// a whole period from now
+				_stats.overruns++;
+				deadline = nowUs() + _periodUs;
+			}
+			waitUntil( deadline );
+		}
+	}
+
+
+	uint32_t periodUs( ) const
+	{
+		return _periodUs;
+	}
+
+
+	void setPeriodUs( uint32_t periodUs )
+	{
+		_periodUs = periodUs;
+	}
+
+
+	const LoopStats& stats( ) const
+	{
+		return _stats;
+	}
+
+
+	void clearStats( )
+	{
+		_stats.clear();
+	}
+
+
+private:
+	// The sleep is rounded up, so a tick never starts before its deadline
+	static void waitUntil( uint32_t deadline )
+	{
+		int32_t slack;
+		while ( ( slack = static_cast< int32_t >( deadline - nowUs() ) ) > 0 )
+			ev3cxx::delayMs( ( slack + 999 ) / 1000 );
+	}
+
+
+	uint32_t _periodUs;
+	LoopStats _stats;
+};
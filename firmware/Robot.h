@@ -3,13 +3,25 @@
 
 #define ATOMS_NO_EXCEPTION
 
-#include <atoms/communication/avakar.h>
-#include <atoms/numeric/rolling_average.h>
+#include <atoms/numeric/filter.h>
+#include <atoms/numeric/fixed.h>
+#include <atoms/control/pid.h>
 
 #include "ev3cxx.h"
 
 #include "RobotGeometry.h"
 #include "DifferentialDrive.h"
+#include "PeriodicLoop.h"
+#include "MotionProfile.h"
+#include "Odometry.h"
+#include "Actuator.h"
+#include "Sensors.h"
+#include "Sonar.h"
+#include "Detector.h"
+#include "Telemetry.h"
+#include "TelemetrySchema.h"
+#include "FlightRecorder.h"
+#include "Parameters.h"
 
 using ev3cxx::display;
 
@@ -26,66 +38,32 @@ struct LineSensor
 	LineSensor( ev3cxx::ColorSensor& s ) : _sensor( s ) { }
 
 
-	int _val( )
+	void push( int r )
 	{
-		int r = _sensor.reflected( true, false );
 		_aFast.push( r );
 		_aSlow.push( r );
-		return r;
 	}
 
 
 	int reflectedFast( )
 	{
-		_val();
-		return _aFast.get_average();
+		return _aFast.get();
 	}
 
 
 	int reflectedSlow( )
 	{
-		_val();
-		return _aSlow.get_average();
+		return _aSlow.get();
 	}
 
 
 	ev3cxx::ColorSensor& _sensor;
-	atoms::RollingAverage < int, 3 > _aFast;
-	atoms::RollingAverage < int, 20 > _aSlow;
+	// Shifts 1 and 3 respond like rolling averages of 3 and 15 samples
+	atoms::ExpFilter < int32_t, 1 > _aFast;
+	atoms::ExpFilter < int32_t, 3 > _aSlow;
 };
 
 
-void packet_send_color_sensors( ev3cxx::Bluetooth& bt, int lCalVal, int rCalVal, int errorNeg )
-{
-	atoms::AvakarPacket packetOut;
-
-	packetOut.set_command( 0 );
-	packetOut.push < uint8_t >( lCalVal );
-	packetOut.push < uint8_t >( rCalVal );
-	packetOut.push < uint8_t >( lCalVal + rCalVal );
-	packetOut.push < int8_t >( errorNeg );
-	for ( char ch: packetOut ) {
-		bt.write( ch );
-	}
-	packetOut.clear();
-}
-
-
-void packet_send_motors_line( ev3cxx::Bluetooth& bt, int motorLSpeed, int motorRSpeed, int errorNegLine )
-{
-	atoms::AvakarPacket packetOut;
-
-	packetOut.set_command( 1 );
-	packetOut.push < int16_t >( motorLSpeed );
-	packetOut.push < int16_t >( motorRSpeed );
-	packetOut.push < int16_t >( errorNegLine );
-	for ( char ch: packetOut ) {
-		bt.write( ch );
-	}
-	packetOut.clear();
-}
-
-
 void beepVolume( int vol )
 {
 	ev3_speaker_set_volume( vol );
@@ -119,6 +97,10 @@ void beepTest( )
 class Robot
 {
 public:
+	// Q16.16, the EV3 has no FPU
+	using LineFix = atoms::Fixed < 16, 16 >;
+	using LinePid = atoms::FilteredPid < LineFix >;
+
 	enum class State
 	{
 		PositionReached = 0,
@@ -152,12 +134,14 @@ public:
 	       ev3cxx::TouchSensor& TouchStop,
 	       ev3cxx::BrickButton& BtnEnter, ev3cxx::BrickButton& BtnStop, ev3cxx::MotorTank& Motors,
 	       ev3cxx::Motor& MotorGate,
-	       Logger& Log, ev3cxx::Bluetooth& Bt, ev3cxx::UltrasonicSensor& sonar, ev3cxx::Motor& motorSensor,
-	       Debug DebugGlobal = Debug::No )
+	       Logger& Log, ev3cxx::Bluetooth& Bt, SonarService& sonar, ev3cxx::Motor& motorSensor,
+	       SensorSampler& Sensors, FlightRecorder& Recorder, Debug DebugGlobal = Debug::No )
 			: robotGeometry( rGeometry ),
 			  lineL( ColorL ), lineR( ColorR ), ketchupSensor( TouchStop ), btnEnter( BtnEnter ), btnStop( BtnStop ),
 			  motors( Motors ), motorGate( MotorGate ), log( Log ), bt( Bt ),
 			  forwardSpeed( 23 ),
+			  cruiseSpeed( 23 ),
+			  stepLengthMm( 250 ),
 			  distanceTargetDiff( 100 ),
 			  errorPosThreshold( 100 ),
 			  rotateSensorThreshold( 30 ),
@@ -165,7 +149,17 @@ public:
               rotateSensorDistanceDiff( 170 ),
               debugGlobal( DebugGlobal ),
               sonar( sonar ),
-              motorSensor( motorSensor ) { }
+              motorSensor( motorSensor ),
+              sensors( Sensors ),
+              recorder( Recorder ),
+              linePid( { LineFix( 1.0f / steerDivisor ), LineFix( 0 ), LineFix( 0 ), LineFix( 1 ),
+                         LineFix( -40 ), LineFix( 40 ) } ),
+              odometry( rGeometry ),
+              wheelDiameterMm( rGeometry.wheelDiameter() ),
+              wheelBaseMm( rGeometry.wheelBase() )
+	{
+		addParameters();
+	}
 
 
 	void debugCheckGlobal( Debug& local )
@@ -180,35 +174,109 @@ public:
 		log.logWarning( "EXIT", "exit()" );
 		ledRed();
 		motorsBrake();
+		recorder.record( FlightEventType::Exit, static_cast< uint8_t >( exitCode ) );
+		if ( !dumpFlightRecorder() )
+			log.logWarning( "EXIT", "recorder not saved" );
 		ev3cxx::delayMs( 500 );
 		std::exit( exitCode );
 	}
 
 
-	void motorsBrake( bool brake = false )
+	// Applies the tuned parameters unless a primitive is running and sends them
+	// back through telemetry; also called while the robot waits for the start
+	void safePoint( )
+	{
+		if ( primitiveDepth != 0 )
+			return;
+		parameters.apply( [ & ]( uint8_t id, int32_t value, bool changed ) {
+			if ( changed )
+				recorder.record( FlightEventType::Parameter, id, int16_t( value ), int16_t( value >> 16 ) );
+			if ( telemetry )
+				telemetry->send < tlm::Parameter >( id, value );
+		} );
+	}
+
+
+	// Also called on a failed assert, so it must not log
+	bool dumpFlightRecorder( )
+	{
+		return !recorderFile || recorder.dump( recorderFile );
+	}
+
+
+	// Every motion primitive starts with enterPrimitive() and returns through
+	// leavePrimitive(), nested primitives included
+	void enterPrimitive( FlightPrimitive p, int16_t a0 = 0, int16_t a1 = 0 )
+	{
+		safePoint();
+		// Nobody polls the sensor ring between primitives, so it fills up and drops
+		// the newest frames; take the queued ones, the primitive then sees fresh frames
+		if ( primitiveDepth == 0 )
+			sense();
+		primitiveDepth++;
+		recorder.begin( p, a0, a1 );
+	}
+
+
+	template < typename Result >
+	Result leavePrimitive( FlightPrimitive p, Result result )
+	{
+		primitiveDepth--;
+		return recorder.end( p, result );
+	}
+
+
+	void motorsOn( int a, int b )
 	{
+		recorder.motors( a, b );
+		motors.on( a, b );
+		commandedA = a;
+		commandedB = b;
+	}
+
+
+	void motorsOff( bool brake = false )
+	{
+		recorder.record( FlightEventType::Motors, brake ? 2 : 1 );
 		motors.off( brake );
+		commandedA = commandedB = 0;
+	}
+
+
+	// Starts a move or turn at the speed the motors already run at in its direction
+	// (signA, signB), so a move chained to another one does not drop to minSpeed.
+	// The top speed is the tuned forwardSpeed.
+	void startProfile( MotionProfile& profile, int distanceDeg, int signA, int signB )
+	{
+		MotionProfile::Config c = profile.config();
+		c.maxSpeed = std::max( c.minSpeed, forwardSpeed );
+		profile.setConfig( c );
+		profile.start( distanceDeg, std::max( 0, std::min( commandedA * signA, commandedB * signB ) ) );
+	}
+
+
+	void motorsBrake( bool brake = false )
+	{
+		motorsOff( brake );
 		motorGate.off( brake );
 	}
 
 
+	// Homes the gate and the sensor arm; the colour sensors are left to
+	// calibrateSensor(), which may run at the same time
 	void init( )
 	{
-		// Init ColorSensor:r
-		// colorL.reflected() is blocking function
-		// => If the sensor is not connected then the program freezes
-		lineL._sensor.reflected();
-		lineR._sensor.reflected();
 		gateInit();
-		brakeGate();
 
 
 		closeSensorArm();
+		arm.wait();
 		openSensorArm();
-		ev3cxx::delayMs( 1000 );
+		arm.wait();
 		closeSensorArm();
 
-		brakeSensorArm();
+		arm.wait();
+		gate.wait();
 	}
 
 
@@ -244,18 +312,18 @@ public:
 
 	void brakeGate( )
 	{
-		motorGate.off( true );
+		gate.stop();
 	}
 
 
+	// Gate and sensor arm moves do not block, they end by stall detection in
+	// actuator_task; the durations are upper bounds
 	void openGate( )
 	{
 		// const float gatePositionOpen = 0.26;
 		// motorGate.resetPosition();
 		// motorGate.onForRotations(-20, gatePositionOpen, true, false);
-		motorGate.on( -20 );
-		ev3cxx::delayMs( 1000 );
-		brakeGate();
+		gate.move( -20, 1000 );
 	}
 
 
@@ -264,16 +332,14 @@ public:
 		// const float gatePositionClose = 0.26;
 		// motorGate.resetPosition();
 		// motorGate.onForRotations(20, gatePositionClose, true, false);
-		motorGate.on( 20 );
-//		motorGate.on( -20 );
-		ev3cxx::delayMs( 1000 );
-		brakeGate();
+		gate.move( 20, 1000 );
+//		gate.move( -20, 1000 );
 	}
 
 
 	void brakeSensorArm( )
 	{
-		motorSensor.off( true );
+		arm.stop();
 	}
 
 
@@ -282,9 +348,7 @@ public:
 		// const float gatePositionOpen = 0.26;
 		// motorGate.resetPosition();
 		// motorGate.onForRotations(-20, gatePositionOpen, true, false);
-		motorSensor.on( 20 );
-		ev3cxx::delayMs( 400 );
-		brakeSensorArm();
+		arm.move( 20, 400 );
 	}
 
 
@@ -293,40 +357,151 @@ public:
 		// const float gatePositionClose = 0.26;
 		// motorGate.resetPosition();
 		// motorGate.onForRotations(20, gatePositionClose, true, false);
-		motorSensor.on( -20 );
-		ev3cxx::delayMs( 700 );
-		brakeSensorArm();
+		arm.move( -20, 700 );
+	}
+
+
+	// Called periodically from actuator_task
+	void updateActuators( )
+	{
+		gate.update();
+		arm.update();
 	}
 
 
 	void calibrateSensor( Debug debugLocal = Debug::Default )
 	{
+		enterPrimitive( FlightPrimitive::Calibrate );
 		debugCheckGlobal( debugLocal );
 		const int robotCalDeg = 360;
 
-		motors.leftMotor().resetPosition();
-		motors.rightMotor().resetPosition();
-		motors.on( 25, -25 );
-		while ( ( motors.leftMotor().degrees() < robotGeometry.rotateDegrees( robotCalDeg ) ) &&
-		        ( motors.rightMotor().degrees() < robotGeometry.rotateDegrees( robotCalDeg ) ) ) {
+		ReflectionCalibration& calL = sensors.calibrationL();
+		ReflectionCalibration& calR = sensors.calibrationR();
+
+		// The first reads of the colour sensors block; if a sensor is not connected,
+		// the program freezes here.
+		// Holding ENTER during the start forces the calibration spin
+		if ( calibrationFile && !btnEnter.isPressed() &&
+		     loadCalibration( calibrationFile, calL, calR ) && calibrationMatches() ) {
+			log.logInfo( "CAL", "cached" );
+			leavePrimitive( FlightPrimitive::Calibrate, 0 );
+			return;
+		}
+
+		int refL, refR;
+		sampleInPlace( refL, refR );
+		calL.clear();
+		calR.clear();
+		calL.setRawReference( refL );
+		calR.setRawReference( refR );
+
+		markTravel();
+		motorsOn( 25, -25 );
+		while ( ( travelL() < robotGeometry.rotateDegrees( robotCalDeg ) ) &&
+		        ( travelR() < robotGeometry.rotateDegrees( robotCalDeg ) ) ) {
 			ev3cxx::delayMs( 10 );
 
-			lineL._sensor.calibrateReflection();
-			lineR._sensor.calibrateReflection();
+			calL.sample( lineL._sensor.reflected( false, false ) );
+			calR.sample( lineR._sensor.reflected( false, false ) );
 		}
-		motors.off( false );
+		motorsOff( false );
+
+		calL.build();
+		calR.build();
+		log.logInfo( "CAL", "L {}-{}" ) << calL.rawMin() << calL.rawMax();
+		log.logInfo( "CAL", "R {}-{}" ) << calR.rawMin() << calR.rawMax();
+		if ( calibrationFile && !saveCalibration( calibrationFile, calL, calR ) )
+			log.logWarning( "CAL", "not saved" );
+		leavePrimitive( FlightPrimitive::Calibrate, 0 );
+	}
+
+
+	// Mean of a few raw samples taken in place
+	void sampleInPlace( int& l, int& r )
+	{
+		const int count = 10;
+		l = r = 0;
+		for ( int i = 0; i != count; i++ ) {
+			l += lineL._sensor.reflected( false, false );
+			r += lineR._sensor.reflected( false, false );
+			ev3cxx::delayMs( 5 );
+		}
+		l = ( l + count / 2 ) / count;
+		r = ( r + count / 2 ) / count;
+	}
+
+
+	// Compares the start position with the reading stored with the loaded calibration
+	bool calibrationMatches( )
+	{
+		int l, r;
+		sampleInPlace( l, r );
+		if ( !sensors.calibrationL().matches( l, calibrationTolerance ) ||
+		     !sensors.calibrationR().matches( r, calibrationTolerance ) ) {
+			log.logInfo( "CAL", "drift {} {}" ) << l << r;
+			return false;
+		}
+		return true;
+	}
+
+
+	// Feeds all frames published by the sensor task since the last call into the line
+	// filters and the odometry
+	const SensorFrame& sense( )
+	{
+		sensors.poll( [ & ]( const SensorFrame& f ) {
+			recorder.sensors( f );
+			lineL.push( f.colorL );
+			lineR.push( f.colorR );
+			// MotorTank's left motor drives the physical right wheel
+			odometry.update( f.encoderR, f.encoderL );
+		} );
+		return sensors.latest();
+	}
+
+
+	// The encoders are never reset, so the odometry sees continuous readings;
+	// primitives measure their travel relative to the mark
+	void markTravel( )
+	{
+		travelStartL = motors.leftMotor().degrees();
+		travelStartR = motors.rightMotor().degrees();
+	}
+
+
+	int travelL( )
+	{
+		return motors.leftMotor().degrees() - travelStartL;
+	}
+
+
+	int travelR( )
+	{
+		return motors.rightMotor().degrees() - travelStartR;
 	}
 
 
 	bool enemyDetected( )
 	{
 //		return false;
-		return sonar.centimeters() < 20;
+		for ( int i = 0; i != sonar.sensorCount(); i++ ) {
+			SonarReading r = sonar.read( i );
+			if ( !r.stale && r.timeUs != lastPingUs[ i ] ) {
+				lastPingUs[ i ] = r.timeUs;
+				recorder.recordAt( r.timeUs, FlightEventType::Sonar, i, r.cm );
+			}
+		}
+		Detector::State last = detector.detect();
+		Detector::State state = detector.update();
+		if ( state != last )
+			recorder.record( FlightEventType::Detector, state, detector.distanceCm(), detector.closingCmPerS() );
+		return state == Detector::Enemy;
 	}
 
 
 	std::pair < int, int > lineError( )
 	{
+		sense();
 		int l = lineL.reflectedFast();
 		int r = lineR.reflectedFast();;
 
@@ -336,85 +511,152 @@ public:
 
 	State _moveForward( int distanceMm )
 	{
+		enterPrimitive( FlightPrimitive::MoveForward, distanceMm );
 		int distanceDeg = robotGeometry.distanceToDegrees( distanceMm );
-		motors.leftMotor().resetPosition();
-		motors.rightMotor().resetPosition();
-		motors.on( forwardSpeed, forwardSpeed );
-		ev3cxx::delayMs( 5 );
-		while ( motors.leftMotor().degrees() < distanceDeg &&
-		        motors.rightMotor().degrees() < distanceDeg ) {
+		markTravel();
+		startProfile( moveProfile, distanceDeg, 1, 1 );
+		State result = State::PositionReached;
+		controlLoop.run( [ & ] {
+			sense();
+			int travelled = std::max( travelL(), travelR() );
+			if ( moveProfile.done( travelled ) )
+				return false;
 			// log.logInfo("DEBUG", "R: {} - {}") << distanceDeg << motors.rightMotor().degrees();
 
 			if ( btnStop.isPressed() )
 				exit( 1 );
-			if ( enemyDetected() )
-				return State::RivalDetected;
-			ev3cxx::delayMs( 5 );
-		}
+			if ( enemyDetected() ) {
+				result = State::RivalDetected;
+				return false;
+			}
+			int speed = moveProfile.speed( travelled );
+			motorsOn( speed, speed );
+			return true;
+		} );
 
 		// log.logInfo("DEBUG", "R: {} - {}") << position;
-		return State::PositionReached;
+		return leavePrimitive( FlightPrimitive::MoveForward, result );
 	}
 
 
 	State _moveBackward( int distanceMm )
 	{
+		enterPrimitive( FlightPrimitive::MoveBackward, distanceMm );
 		int distanceDeg = -robotGeometry.distanceToDegrees( distanceMm );
-		motors.leftMotor().resetPosition();
-		motors.rightMotor().resetPosition();
-		motors.on( -forwardSpeed, -forwardSpeed );
-		ev3cxx::delayMs( 5 );
-		while ( motors.leftMotor().degrees() > distanceDeg &&
-		        motors.rightMotor().degrees() > distanceDeg ) {
+		markTravel();
+		startProfile( moveProfile, distanceDeg, -1, -1 );
+		State result = State::PositionReached;
+		controlLoop.run( [ & ] {
+			sense();
+			int travelled = std::min( travelL(), travelR() );
+			if ( moveProfile.done( travelled ) )
+				return false;
 			// log.logInfo("DEBUG", "R: {} - {}") << distanceDeg << motors.rightMotor().degrees();
 
 			if ( btnStop.isPressed() )
 				exit( 1 );
-			if ( enemyDetected() )
-				return State::RivalDetected;
-			ev3cxx::delayMs( 5 );
-		}
-		return State::PositionReached;
+			if ( enemyDetected() ) {
+				result = State::RivalDetected;
+				return false;
+			}
+			int speed = moveProfile.speed( travelled );
+			motorsOn( -speed, -speed );
+			return true;
+		} );
+		return leavePrimitive( FlightPrimitive::MoveBackward, result );
 	}
 
 
+	// Signed difference between the odometry heading and the nearest grid direction,
+	// counter-clockwise positive, -45 to 45 degrees
+	int lineHeadingOffsetDeg( )
+	{
+		Angle h = odometry.heading();
+		Angle line = ( h + QUARTER_TURN / 2 ) & ~( QUARTER_TURN - 1 );
+		return static_cast< int >( ( int64_t( static_cast< int32_t >( h - line ) ) * 360 ) >> 32 );
+	}
+
+
+	// Re-acquires the line by rotating in place. The side of the line is predicted
+	// from the odometry heading (the lines run along the grid) or, when the robot is
+	// nearly aligned, from the side the line was last seen on. The robot turns fast
+	// towards the expected crossing and slows down only near it; if the line is not
+	// there, it sweeps slowly back to the other side.
 	void findLine( )
 	{
+		enterPrimitive( FlightPrimitive::FindLine );
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::GREEN );
-		lineL._aSlow.clear( 100 );
-		lineR._aSlow.clear( 100 );
-
-		int degrees = 40;
-		_rotate( degrees );
+		lineL._aSlow.reset( 100 );
+		lineR._aSlow.reset( 100 );
+		sense();
+
+		int offset = lineHeadingOffsetDeg();
+		int dir = std::abs( offset ) >= 5 ? -sgn( offset ) : lastLineSide;
+		int expected = std::max( std::abs( offset ), 20 );
+		int slowFrom = robotGeometry.rotateDegrees( std::max( expected - findLineSlowZone, 0 ) );
+		int giveUp = robotGeometry.rotateDegrees( expected + 60 );
+		log.logInfo( "DEBUG", "findLine {} {}" ) << offset << dir;
+
+		auto swept = [ & ] {
+			return ( std::abs( travelL() ) + std::abs( travelR() ) ) / 2;
+		};
+		auto dark = [ & ] {
+			return lineL.reflectedFast() < rotateSensorThreshold ||
+			       lineR.reflectedFast() < rotateSensorThreshold;
+		};
 
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::ORANGE );
-
-//		if ( degrees > 0 ) {
-		motors.on( -10, 10 );
-//		} else {
-//			motors.on( 10, -10 );
-//		}
-
-		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
-		while ( lineL.reflectedSlow() > rotateSensorThreshold &&
-		        lineR.reflectedSlow() > rotateSensorThreshold ) {
+		markTravel();
+		bool found = false;
+		controlLoop.run( [ & ] {
 			if ( btnStop.isPressed() )
 				exit( 1 );
-
-			ev3cxx::delayMs( 1 );
+			sense();
+			if ( dark() ) {
+				found = true;
+				return false;
+			}
+			int s = swept();
+			if ( s >= giveUp )
+				return false;
+			int speed = s < slowFrom ? findLineFastSpeed : 10;
+			motorsOn( dir * speed, -dir * speed );
+			return true;
+		} );
+
+		if ( !found ) {
+			// Wrong side, sweep slowly through the start position to the other one
+			ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
+			dir = -dir;
 		}
-//
-		while ( lineL.reflectedSlow() < rotateSensorThreshold ||
-		        lineR.reflectedSlow() < rotateSensorThreshold ) {
+		// The slow filters lag behind the fast ones which stopped the sweep, keep
+		// turning slowly until they see the line too
+		motorsOn( dir * 10, -dir * 10 );
+		scanLoop.run( [ & ] {
 			if ( btnStop.isPressed() )
 				exit( 1 );
-
-			ev3cxx::delayMs( 1 );
-		}
+			sense();
+			return lineL.reflectedSlow() >= rotateSensorThreshold &&
+			       lineR.reflectedSlow() >= rotateSensorThreshold;
+		} );
+
+		// Center the line between the sensors
+		motorsOn( dir * 10, -dir * 10 );
+		scanLoop.run( [ & ] {
+			if ( btnStop.isPressed() )
+				exit( 1 );
+			sense();
+			return lineL.reflectedSlow() < rotateSensorThreshold ||
+			       lineR.reflectedSlow() < rotateSensorThreshold;
+		} );
 
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::GREEN );
 
-		motors.off();
+		motorsOff();
+		sense();
+		odometry.correctHeading( odometry.heading() - static_cast< Angle >(
+			( int64_t( lineHeadingOffsetDeg() ) << 32 ) / 360 ) );
+		leavePrimitive( FlightPrimitive::FindLine, State::PositionReached );
 	}
 
 
@@ -424,27 +666,30 @@ public:
 		int distanceDeg =  robotGeometry.rotateDegrees( std::abs(degrees) );
 		log.logInfo( "DEBUG", "distanceDeg = {}" ) << distanceDeg;
 
-		motors.leftMotor().resetPosition();
-		motors.rightMotor().resetPosition();
+		markTravel();
 //		int degLeft = motors.leftMotor().degrees();
 
 //		int degRight = motors.leftMotor().degrees();
 
 		ev3cxx::delayMs( 1 );
 
-		if ( degrees > 0 ) {
-			motors.on( forwardSpeed, -forwardSpeed );
-		} else {
-			motors.on( -forwardSpeed, forwardSpeed );
-		}
-
-		while ( ( motors.leftMotor().degrees() ) < distanceDeg &&
-		        ( motors.rightMotor().degrees() ) < distanceDeg ) {
+		startProfile( turnProfile, distanceDeg, sgn( degrees ), -sgn( degrees ) );
+		controlLoop.run( [ & ] {
 			if ( btnStop.isPressed() ) {
 				exit( 1 );
 			}
-			ev3cxx::delayMs( 5 );
-		}
+			sense();
+			int travelled = std::max( travelL(), travelR() );
+			if ( turnProfile.done( travelled ) )
+				return false;
+			int speed = turnProfile.speed( travelled );
+			if ( degrees > 0 ) {
+				motorsOn( speed, -speed );
+			} else {
+				motorsOn( -speed, speed );
+			}
+			return true;
+		} );
 
 		return State::PositionReached;
 	}
@@ -452,25 +697,56 @@ public:
 
 	State _step( Debug debugLocal = Debug::Default, bool ignoreKetchup = false, int ketchupCount = 0)
 	{
+		enterPrimitive( FlightPrimitive::Step, ignoreKetchup, ketchupCount );
+		debugCheckGlobal( debugLocal );
+		const bool sendPackets = telemetry && ( debugLocal & Debug::Packet );
 		int target = robotGeometry.distanceToDegrees( 40 );
 		// int target = robotGeometry.distanceToDegrees( 80 );
-		motors.leftMotor().resetPosition();
-		motors.rightMotor().resetPosition();
-		lineL._aSlow.clear( 100 );
-		lineR._aSlow.clear( 100 );
+		markTravel();
+		lineL._aSlow.reset( 100 );
+		lineR._aSlow.reset( 100 );
+
+		// The touch sensor has to be pressed in more than 20 % of the last 50 control
+		// ticks (250 ms)
+		atoms::BitWindow < 50 > ketchupTrigger;
+		linePid.reset();
+		// Cruise between intersections, cross them at forwardSpeed
+		MotionProfile lineProfile( { forwardSpeed, std::max( forwardSpeed, cruiseSpeed ),
+		                             moveProfile.config().accel, moveProfile.config().decel,
+		                             moveProfile.config().degPerTick } );
+		lineProfile.start( robotGeometry.distanceToDegrees( stepLengthMm - stepOffsetMm ), forwardSpeed );
+		stepOffsetMm = 0;
+
+		// Pickup runs while following the line: the arm opens on the trigger and
+		// closes after pickupDistanceMm, timed by the encoders
+		enum class Pickup { None, Open, Done } pickup = Pickup::None;
+		int pickupStart = 0;
+		const int pickupDistance = robotGeometry.distanceToDegrees( pickupDistanceMm );
 
-		atoms::RollingAverage < float, 50 > ketchupTrigger;
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
-		while ( true ) {
+		State result = State::PositionReached;
+		controlLoop.run( [ & ] {
+			const SensorFrame& frame = sense();
 			int errorNeg = lineR.reflectedFast() - lineL.reflectedFast();
 			int errorPos = lineR.reflectedSlow() + lineL.reflectedSlow();
 
-			int speedGain = errorNeg / 12;
+			int speedGain = -linePid.step( LineFix( errorNeg ), LineFix( 0 ) ).to_signed();
+			if ( std::abs( errorNeg ) > 5 )
+				lastLineSide = sgn( errorNeg );
 			// int motorLSpeed = forwardSpeed + speedGain;
 			// int motorRSpeed = forwardSpeed - speedGain;
 
-			int motorLSpeed = forwardSpeed - speedGain;
-			int motorRSpeed = forwardSpeed + speedGain;
+			int speed = lineProfile.speed( travelR() );
+			if ( pickup == Pickup::Open )
+				speed = std::min( speed, forwardSpeed );
+			int motorLSpeed = speed - speedGain;
+			int motorRSpeed = speed + speedGain;
+			if ( sendPackets ) {
+				int l = lineL.reflectedFast();
+				int r = lineR.reflectedFast();
+				telemetry->send < tlm::ColorSensors >( l, r, l + r, errorNeg );
+				telemetry->send < tlm::MotorsLine >( motorLSpeed, motorRSpeed, errorNeg );
+			}
 
 			// log
 			// log.logInfo("DEBUG", "S: {} - {}") << motors.rightMotor().degrees() << target;
@@ -479,108 +755,201 @@ public:
 			if ( btnStop.isPressed() ) {
 				exit( 1 );
 			}
-			if ( motors.rightMotor().degrees() > target && errorPos < errorPosThreshold ) {
+			if ( travelR() > target && errorPos < errorPosThreshold ) {
 
-				motors.on( motorRSpeed, motorLSpeed );
+				motorsOn( motorRSpeed, motorLSpeed );
 				// ev3cxx::delayMs(25);
 				// motors.off();
 
 				ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::ORANGE );
 				beep( 1000, 200 );
-				return State::PositionReached;
+				result = pickup == Pickup::None ? State::PositionReached : State::KetchupDetected;
+				return false;
 			}
 			// if ( !ketchupSensor.isPressed() ) {
-			if ( ketchupSensor.isPressed() ) {
-				ketchupTrigger.push( 1 );
-			} else {
-				ketchupTrigger.push( 0 );
-			}
-			// if ( ketchupTrigger.get_average() > 0.9 ) {
-			if ( ketchupTrigger.get_average() > 0.2 && !ignoreKetchup && ketchupCount < 2) {
-				motors.off();
-				ev3cxx::delayMs( 100 );
+			ketchupTrigger.push( frame.touch );
+			if ( pickup == Pickup::None && ketchupTrigger.count() > 10 && !ignoreKetchup && ketchupCount < 2) {
 				openSensorArm();
-				ev3cxx::delayMs( 100 );
-				auto s = _moveForward( 110 );
-				ev3cxx::delayMs( 5 );
+				pickup = Pickup::Open;
+				pickupStart = travelR();
+			}
+			if ( pickup == Pickup::Open && travelR() - pickupStart >= pickupDistance ) {
 				closeSensorArm();
-				s = _moveBackward( 50 );
-				motors.off();
-
-//				ev3cxx::delayMs( 1000 );
-				findLine();
+				pickup = Pickup::Done;
 				beep( 2000, 200 );
-//				ev3cxx::delayMs( 1000 );
-				return std::max( State::KetchupDetected, s );
 			}
 			if ( enemyDetected() ) {
 				beep( 400, 200 );
-				return State::RivalDetected;
+				result = State::RivalDetected;
+				return false;
 			}
-			motors.on( motorRSpeed, motorLSpeed );
-			ev3cxx::delayMs( 5 );
-		}
+			motorsOn( motorRSpeed, motorLSpeed );
+			return true;
+		} );
+
+		// Intersection or rival came before the closing distance
+		if ( pickup == Pickup::Open )
+			closeSensorArm();
+		return leavePrimitive( FlightPrimitive::Step, result );
 	}
 
 
-	State step( int numberOfStep, Debug debugLocal = Debug::Default, bool ignoreKetchup = false, int ketchupCount = 0)
+	// With settle == false the robot stops following the line as the sensors cross the
+	// intersection, so that arcTurn() can continue from there at speed
+	State step( int numberOfStep, Debug debugLocal = Debug::Default, bool ignoreKetchup = false, int ketchupCount = 0,
+	            bool settle = true )
 	{
-		State returnState;
-
 		for ( int cntOfStep = 0; cntOfStep < numberOfStep; ++cntOfStep ) {
-			returnState = _step( debugLocal, ignoreKetchup, ketchupCount );
-			if ( returnState != State::PositionReached && returnState != State::KetchupDetected ) {
-//				motors.off();
-				return returnState;
+			stepLineState = _step( debugLocal, ignoreKetchup, ketchupCount );
+			if ( stepLineState != State::PositionReached && stepLineState != State::KetchupDetected ) {
+//				motorsOff();
+				return stepLineState;
 			}
 		}
 		// auto s = _moveForward( 70 );
 		// 85 relativně fungovalo
 
-		State s;
-		if ( returnState != State::KetchupDetected ) {
-			s = _moveForward( 100 );
-		}
+		if ( !settle )
+			return stepLineState;
+		// Pickup does not leave the line, so the robot always settles on the intersection
+		State s = _moveForward( settleMm );
 
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
 
-//		motors.off();
-		return std::max( returnState, s );
+//		motorsOff();
+		// A rival in the settle leaves the robot past the crossing, stepLineState tells
+		// it apart from one seen before it and keeps a ketchup picked up on the way
+		return s == State::RivalDetected ? s : stepLineState;
+	}
+
+
+	// Follows the line backwards to the next intersection and settles on it. The
+	// sensors trail behind the wheels, which makes pure line following unstable, so
+	// the odometry heading offset from the grid is fed into the steering as well.
+	// Crossings within lockoutMm are ignored; starting settled on an intersection the
+	// sensors cross its line first. The sonar looks forward, so rivals are not checked.
+	State stepBackward( int lockoutMm )
+	{
+		enterPrimitive( FlightPrimitive::StepBackward, lockoutMm );
+		int target = robotGeometry.distanceToDegrees( lockoutMm );
+		markTravel();
+		lineL._aSlow.reset( 100 );
+		lineR._aSlow.reset( 100 );
+		linePid.reset();
+
+		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::ORANGE );
+		controlLoop.run( [ & ] {
+			if ( btnStop.isPressed() )
+				exit( 1 );
+			sense();
+			int errorNeg = lineR.reflectedFast() - lineL.reflectedFast();
+			int errorPos = lineR.reflectedSlow() + lineL.reflectedSlow();
+			if ( -travelR() > target && errorPos < errorPosThreshold ) {
+				beep( 1000, 200 );
+				return false;
+			}
+			int speedGain = -linePid.step( LineFix( errorNeg ), LineFix( 0 ) ).to_signed() -
+			                lineHeadingOffsetDeg() * reverseHeadingGain;
+			motorsOn( -reverseSpeed + speedGain, -reverseSpeed - speedGain );
+			return true;
+		} );
+
+		// The wheels are settleMm past the intersection now
+		State s = _moveForward( settleMm );
+		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
+		return leavePrimitive( FlightPrimitive::StepBackward, s );
+	}
+
+
+	// Turns by +-90 degrees onto the perpendicular line without stopping. Starts with
+	// the sensors on the crossing (step() without settling) and drives a quarter circle
+	// of arcRadiusMm, which ends with the wheels arcRadiusMm past the intersection on the
+	// new line. The odometry heading ends the arc and the line sensors confirm the
+	// capture; if they do not see the line, the robot falls back to findLine().
+	State arcTurn( int degrees )
+	{
+		enterPrimitive( FlightPrimitive::ArcTurn, degrees );
+		const int dir = sgn( degrees );
+		if ( settleMm > arcRadiusMm ) {
+			State s = _moveForward( settleMm - arcRadiusMm );
+			if ( s == State::RivalDetected )
+				return leavePrimitive( FlightPrimitive::ArcTurn, s );
+		}
+
+		// Wheel speeds in the ratio of the inner and outer wheel radius
+		const int base = robotGeometry.wheelBase();
+		const int outer = forwardSpeed;
+		const int inner = outer * ( 2 * arcRadiusMm - base ) / ( 2 * arcRadiusMm + base );
+		const Angle start = odometry.heading();
+		auto turned = [ & ] {
+			return dir * static_cast< int >(
+				( int64_t( static_cast< int32_t >( odometry.heading() - start ) ) * 360 ) >> 32 );
+		};
+
+		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::GREEN );
+		bool captured = false;
+		controlLoop.run( [ & ] {
+			if ( btnStop.isPressed() )
+				exit( 1 );
+			sense();
+			int t = turned();
+			if ( t >= std::abs( degrees ) - arcCaptureDeg &&
+			     ( lineL.reflectedFast() < rotateSensorThreshold || lineR.reflectedFast() < rotateSensorThreshold ) ) {
+				captured = true;
+				return false;
+			}
+			if ( t >= std::abs( degrees ) + arcCaptureDeg )
+				return false;
+			if ( dir > 0 )
+				motorsOn( outer, inner );
+			else
+				motorsOn( inner, outer );
+			return true;
+		} );
+
+		if ( !captured ) {
+			log.logWarning( "ARC", "line not captured" );
+			findLine();
+		}
+		stepOffsetMm = arcRadiusMm;
+		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
+		return leavePrimitive( FlightPrimitive::ArcTurn, State::PositionReached );
 	}
 
 
 	//Dotáčet se podle čáry
 	State rotate( const int degrees, Debug debugLocal = Debug::Default )
 	{
+		enterPrimitive( FlightPrimitive::Rotate, degrees );
 //		display.resetScreen();
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::GREEN );
-		lineL._aSlow.clear( 100 );
-		lineR._aSlow.clear( 100 );
+		lineL._aSlow.reset( 100 );
+		lineR._aSlow.reset( 100 );
 
 		const int odoDeg = sgn( degrees ) * ( std::abs( degrees ) - 40 );
 		log.logInfo( "DEBUG", "odd {}" ) << sgn( degrees ) * ( std::abs( degrees ) - 40 );
 		_rotate( odoDeg );
 
 
-		motors.off();
+		motorsOff();
 		ev3cxx::delayMs(10);
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::RED );
 
 //		LineSensor* crossS = nullptr;
 		if ( degrees > 0 ) {
-			motors.on( 15, -15 );
+			motorsOn( 15, -15 );
 		} else {
-			motors.on( -15, 15 );
+			motorsOn( -15, 15 );
 		}
 
 
-		while ( lineL.reflectedSlow() > rotateSensorThreshold &&
-		        lineR.reflectedSlow() > rotateSensorThreshold ) {
+		scanLoop.run( [ & ] {
 			if ( btnStop.isPressed() )
 				exit( 1 );
-
-			ev3cxx::delayMs( 1 );
-		}
+			sense();
+			return lineL.reflectedSlow() > rotateSensorThreshold &&
+			       lineR.reflectedSlow() > rotateSensorThreshold;
+		} );
 
 		ev3cxx::statusLight.setColor( ev3cxx::StatusLightColor::ORANGE );
 
@@ -602,8 +971,8 @@ public:
 
 		_rotate( sgn( degrees ) * 3 );
 
-		motors.off();
-		return State::PositionReached;
+		motorsOff();
+		return leavePrimitive( FlightPrimitive::Rotate, State::PositionReached );
 	}
 
 
@@ -613,6 +982,47 @@ public:
 	}
 
 
+	void setLinePid( const LinePid::Config& config )
+	{
+		linePid.set_params( config );
+		if ( config.p > LineFix( 0 ) )
+			steerDivisor = static_cast< int >( 1 / config.p.to_float() + 0.5f );
+	}
+
+
+	// Tunable over Bluetooth, the ids are given by the order
+	void addParameters( )
+	{
+		parameters.add( "forwardSpeed", forwardSpeed, 5, 100 );
+		parameters.add( "cruiseSpeed", cruiseSpeed, 5, 100 );
+		parameters.add( "errorPosThreshold", errorPosThreshold, 0, 1000 );
+		parameters.add( "rotateSensorThreshold", rotateSensorThreshold, 0, 100 );
+		parameters.add( "steerDivisor", steerDivisor, 1, 1000, [ this ] {
+			LinePid::Config c = linePid.get_params();
+			c.p = LineFix( 1.0f / steerDivisor );
+			linePid.set_params( c );
+		} );
+		auto geometryChanged = [ this ] {
+			robotGeometry = RobotGeometry( wheelDiameterMm, wheelBaseMm );
+			odometry.setGeometry( robotGeometry );
+		};
+		parameters.add( "wheelDiameterMm", wheelDiameterMm, 20, 200, geometryChanged );
+		parameters.add( "wheelBaseMm", wheelBaseMm, 50, 400, geometryChanged );
+	}
+
+
+	void logLoopStats( )
+	{
+		const LoopStats& c = controlLoop.stats();
+		log.logInfo( "LOOP", "ctl exec {}/{} us" ) << c.execAvgUs() << c.execMaxUs;
+		log.logInfo( "LOOP", "ctl jit {}/{} us" ) << c.jitterAvgUs() << c.jitterMaxUs;
+		log.logInfo( "LOOP", "ctl overrun {}/{}" ) << c.overruns << c.iterations;
+		log.logInfo( "LOOP", "sns overflow {}" ) << sensors.overflowCount();
+		if ( telemetry )
+			log.logInfo( "LOOP", "tlm drop {}/{}" ) << telemetry->dropCount() << telemetry->frameCount();
+	}
+
+
 	RobotGeometry& robotGeometry;
 	LineSensor lineL;
 	LineSensor lineR;
@@ -626,13 +1036,67 @@ public:
 
 	Logger& log;
 	ev3cxx::Bluetooth& bt;
+	// Debug::Packet frames go here when set
+	Telemetry* telemetry = nullptr;
 
 	int forwardSpeed;
+	int cruiseSpeed;
+	int stepLengthMm;
+	int pickupDistanceMm = 110;
+	// Drive from the sensors crossing the line to the wheels over the intersection
+	int settleMm = 100;
+	int arcRadiusMm = 100;
+	int arcCaptureDeg = 15;
+	int reverseSpeed = 15;
+	int reverseHeadingGain = 1;
+	// Distance of the next step already driven by arcTurn()
+	int stepOffsetMm = 0;
+	// Result of the line following of the last step() before its settle
+	State stepLineState = State::PositionReached;
+	// Calibration cache on the SD card, nullptr disables it
+	const char* calibrationFile = "calibration.bin";
+	// Raw units the start position may differ from the reading stored with the cache
+	int calibrationTolerance = 8;
+	int findLineFastSpeed = 30;
+	int findLineSlowZone = 15;
+	// Side the line was last seen on while following it, 1 = left
+	int lastLineSide = 1;
 	int distanceTargetDiff;
 	int errorPosThreshold;
 	int rotateSensorThreshold;
 	int rotateSensorDistanceDiff;
 	Debug debugGlobal;
 
-	ev3cxx::UltrasonicSensor& sonar;
+	SonarService& sonar;
+	Detector detector{ sonar };
+	uint32_t lastPingUs[ SonarService::MAX_SENSORS ] = { };
+	SensorSampler& sensors;
+	FlightRecorder& recorder;
+	// Flight recorder dump on the SD card, nullptr disables it
+	const char* recorderFile = "flight.bin";
+	// Proportional gain of the line regulator is 1 / steerDivisor
+	int steerDivisor = 12;
+	LinePid linePid;
+	Odometry odometry;
+	// Tuned copies of robotGeometry
+	int wheelDiameterMm;
+	int wheelBaseMm;
+	ParameterRegistry parameters;
+	int primitiveDepth = 0;
+	Actuator gate{ motorGate };
+	Actuator arm{ motorSensor };
+	int travelStartL = 0;
+	int travelStartR = 0;
+	// Last motorsOn() powers of the MotorTank motors, 0 after motorsOff()
+	int commandedA = 0;
+	int commandedB = 0;
+	// minSpeed, maxSpeed, accel, decel, degPerTick; maxSpeed is set from
+	// forwardSpeed by startProfile()
+	MotionProfile moveProfile{ { 10, 23, 2, 2, 5 } };
+	MotionProfile turnProfile{ { 10, 23, 2, 2, 5 } };
+
+	// Line following and motion primitives
+	PeriodicLoop controlLoop{ 5000 };
+	// Line searching polls the slow averages
+	PeriodicLoop scanLoop{ 1000 };
 };
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <streambuf>
+
+#include "json11.hpp"
+
+#include "Robot.h"
+
+
+inline json11::Json load_config( std::string fileName )
+{
+	std::ifstream configFile( fileName );
+	std::string configJson( ( std::istreambuf_iterator < char >( configFile ) ),
+	                        std::istreambuf_iterator < char >() );
+
+	std::string ErrorMsg = std::string( "Json parsing error" );
+	return json11::Json::parse( configJson, ErrorMsg );
+}
+
+
+// Line follower gains, speeds are in motor power percent
+inline void load_line_follower( json11::Json config, Robot& robot )
+{
+	json11::Json line = config[ "lineFollower" ];
+	if ( !line.is_object() )
+		return;
+
+	auto fix = [ & ]( const char* key, double def ) {
+		const json11::Json& v = line[ key ];
+		return Robot::LineFix( v.is_number() ? v.number_value() : def );
+	};
+	double limit = line[ "limit" ].is_number() ? line[ "limit" ].number_value() : 40;
+	robot.setLinePid( { fix( "p", 1.0 / 12 ), fix( "i", 0 ), fix( "d", 0 ), fix( "dFilter", 1 ),
+	                    Robot::LineFix( -limit ), Robot::LineFix( limit ) } );
+	if ( line[ "speed" ].is_number() )
+		robot.forwardSpeed = line[ "speed" ].int_value();
+	if ( line[ "cruiseSpeed" ].is_number() )
+		robot.cruiseSpeed = line[ "cruiseSpeed" ].int_value();
+	if ( line[ "stepMm" ].is_number() )
+		robot.stepLengthMm = line[ "stepMm" ].int_value();
+}
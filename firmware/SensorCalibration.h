@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+
+// Maps raw reflection to the calibrated 0 - 100 range through a lookup table, so
+// a read costs one load instead of software floating point on the EV3. Extremes
+// are collected with sample() during the calibration spin, build() fills the table
+// once afterwards.
+class ReflectionCalibration
+{
+public:
+	static constexpr int CAL_MIN = 0;
+	static constexpr int CAL_MAX = 100;
+
+
+	ReflectionCalibration( )
+	{
+		clear();
+	}
+
+
+	void clear( )
+	{
+		_rawMin = 255;
+		_rawMax = 0;
+		_rawReference = -1;
+		// Identity until calibrated
+		for ( int raw = 0; raw != 256; raw++ )
+			_table[ raw ] = raw;
+	}
+
+
+	void sample( int raw )
+	{
+		raw = std::max( 0, std::min( 255, raw ) );
+		_rawMin = std::min( _rawMin, raw );
+		_rawMax = std::max( _rawMax, raw );
+	}
+
+
+	void build( bool clamp = false )
+	{
+		build( _rawMin, _rawMax, clamp );
+	}
+
+
+	void build( int rawMin, int rawMax, bool clamp = false )
+	{
+		_rawMin = rawMin;
+		_rawMax = rawMax;
+		_clamp = clamp;
+		int span = std::max( 1, rawMax - rawMin );
+		for ( int raw = 0; raw != 256; raw++ ) {
+			int v = ( raw - rawMin ) * ( CAL_MAX - CAL_MIN );
+			// round to nearest, also for values below rawMin
+			v = ( v >= 0 ? v + span / 2 : v - span / 2 ) / span + CAL_MIN;
+			if ( clamp )
+				v = v < CAL_MIN ? CAL_MIN : v > CAL_MAX ? CAL_MAX : v;
+			_table[ raw ] = static_cast< int16_t >( v );
+		}
+	}
+
+
+	int16_t operator()( int raw ) const
+	{
+		return _table[ static_cast< uint8_t >( std::max( 0, std::min( 255, raw ) ) ) ];
+	}
+
+
+	bool valid( ) const
+	{
+		return _rawMax > _rawMin;
+	}
+
+
+	int rawMin( ) const
+	{
+		return _rawMin;
+	}
+
+
+	int rawMax( ) const
+	{
+		return _rawMax;
+	}
+
+
+	bool clamped( ) const
+	{
+		return _clamp;
+	}
+
+
+	// Raw reading at the start position when the calibration was made, -1 if unknown
+	int rawReference( ) const
+	{
+		return _rawReference;
+	}
+
+
+	void setRawReference( int raw )
+	{
+		_rawReference = std::max( 0, std::min( 255, raw ) );
+	}
+
+
+	// A reading at the start position is consistent with the calibration if it is
+	// within tolerance of the reference; a dirtier lens or other ambient light moves
+	// it even when it stays inside the calibrated range
+	bool matches( int raw, int tolerance ) const
+	{
+		return _rawReference >= 0 && std::abs( raw - _rawReference ) <= tolerance;
+	}
+
+
+private:
+	int16_t _table[ 256 ];
+	int _rawMin;
+	int _rawMax;
+	int _rawReference;
+	bool _clamp = false;
+};
+
+
+// Calibration cache on the SD card, so the calibration spin can be skipped when the
+// lighting did not change. Bump CALIBRATION_VERSION when the layout or the meaning
+// of the stored values changes.
+static const uint8_t CALIBRATION_VERSION = 2;
+
+struct CalibrationFile
+{
+	struct Sensor
+	{
+		uint8_t rawMin;
+		uint8_t rawMax;
+		uint8_t clamp;
+		uint8_t rawReference;
+	};
+
+	char magic[ 4 ];
+	uint8_t version;
+	uint8_t sensorCount;
+	uint16_t reserved;
+	Sensor sensor[ 2 ];
+	uint32_t checksum;
+
+
+	// Adler-32 of everything before the checksum
+	uint32_t sum( ) const
+	{
+		const uint8_t* p = reinterpret_cast< const uint8_t* >( this );
+		uint32_t a = 1, b = 0;
+		for ( size_t i = 0; i != offsetof( CalibrationFile, checksum ); i++ ) {
+			a = ( a + p[ i ] ) % 65521;
+			b = ( b + a ) % 65521;
+		}
+		return ( b << 16 ) | a;
+	}
+};
+
+
+inline bool saveCalibration( const char* path, const ReflectionCalibration& l, const ReflectionCalibration& r )
+{
+	CalibrationFile f;
+	std::memset( &f, 0, sizeof( f ) );
+	std::memcpy( f.magic, "KCAL", 4 );
+	f.version = CALIBRATION_VERSION;
+	f.sensorCount = 2;
+	const ReflectionCalibration* cal[] = { &l, &r };
+	for ( int i = 0; i != 2; i++ ) {
+		f.sensor[ i ].rawMin = static_cast< uint8_t >( cal[ i ]->rawMin() );
+		f.sensor[ i ].rawMax = static_cast< uint8_t >( cal[ i ]->rawMax() );
+		f.sensor[ i ].clamp = cal[ i ]->clamped();
+		f.sensor[ i ].rawReference = static_cast< uint8_t >( cal[ i ]->rawReference() );
+	}
+	f.checksum = f.sum();
+
+	FILE* file = std::fopen( path, "wb" );
+	if ( !file )
+		return false;
+	bool ok = std::fwrite( &f, sizeof( f ), 1, file ) == 1;
+	return std::fclose( file ) == 0 && ok;
+}
+
+
+// Builds both tables from the cache; fails on a missing, corrupted or outdated file
+inline bool loadCalibration( const char* path, ReflectionCalibration& l, ReflectionCalibration& r )
+{
+	FILE* file = std::fopen( path, "rb" );
+	if ( !file )
+		return false;
+	CalibrationFile f;
+	bool ok = std::fread( &f, sizeof( f ), 1, file ) == 1;
+	std::fclose( file );
+	if ( !ok || std::memcmp( f.magic, "KCAL", 4 ) != 0 || f.version != CALIBRATION_VERSION ||
+	     f.sensorCount != 2 || f.checksum != f.sum() )
+		return false;
+
+	ReflectionCalibration* cal[] = { &l, &r };
+	for ( int i = 0; i != 2; i++ ) {
+		if ( f.sensor[ i ].rawMax <= f.sensor[ i ].rawMin )
+			return false;
+		cal[ i ]->build( f.sensor[ i ].rawMin, f.sensor[ i ].rawMax, f.sensor[ i ].clamp );
+		cal[ i ]->setRawReference( f.sensor[ i ].rawReference );
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atoms/container/spsc_ring.h>
+
+#include "ev3cxx.h"
+#include "PeriodicLoop.h"
+#include "SensorCalibration.h"
+
+
+struct SensorFrame
+{
+	uint32_t timeUs;
+	int16_t colorL;    // calibrated reflection
+	int16_t colorR;
+	int32_t encoderL;  // MotorTank encoders in degrees, see Robot::sense()
+	int32_t encoderR;
+	bool touch;
+};
+
+
+// Samples the fast robot sensors from a dedicated task and publishes timestamped
+// frames to the control loop. sample() is the only producer, poll() the only
+// consumer. The slow ultrasonic sensor has its own task, see SonarService.
+class SensorSampler
+{
+public:
+	SensorSampler( ev3cxx::ColorSensor& colorL, ev3cxx::ColorSensor& colorR, ev3cxx::TouchSensor& touch,
+	               ev3cxx::MotorTank& motors )
+			: colorL( colorL ), colorR( colorR ), touch( touch ), motors( motors ), overflows( 0 ), _latest{ } { }
+
+
+	// Producer side, called periodically from sensor_task
+	void sample( )
+	{
+		SensorFrame f;
+		f.timeUs = nowUs();
+		f.colorL = calL( colorL.reflected( false, false ) );
+		f.colorR = calR( colorR.reflected( false, false ) );
+		f.encoderL = motors.leftMotor().degrees();
+		f.encoderR = motors.rightMotor().degrees();
+		f.touch = touch.isPressed();
+		publish( f );
+	}
+
+
+	// Producer side; the replay in tools/ injects recorded frames here
+	void publish( const SensorFrame& f )
+	{
+		if ( !frames.push( f ) )
+			overflows++;
+	}
+
+
+	// Consumer side; calls onFrame for every frame published since the last poll
+	// and returns true if there was at least one
+	template < typename OnFrame >
+	bool poll( OnFrame onFrame )
+	{
+		bool fresh = false;
+		while ( frames.pop( _latest ) ) {
+			onFrame( _latest );
+			fresh = true;
+		}
+		return fresh;
+	}
+
+
+	const SensorFrame& latest( ) const
+	{
+		return _latest;
+	}
+
+
+	uint32_t overflowCount( ) const
+	{
+		return overflows;
+	}
+
+
+	// Filled by Robot::calibrateSensor() before the sensor task starts
+	ReflectionCalibration& calibrationL( )
+	{
+		return calL;
+	}
+
+
+	ReflectionCalibration& calibrationR( )
+	{
+		return calR;
+	}
+
+
+private:
+	ev3cxx::ColorSensor& colorL;
+	ev3cxx::ColorSensor& colorR;
+	ev3cxx::TouchSensor& touch;
+	ev3cxx::MotorTank& motors;
+
+	uint32_t overflows;
+
+	ReflectionCalibration calL;
+	ReflectionCalibration calR;
+
+	atoms::SpscRing < SensorFrame, 16 > frames;
+	SensorFrame _latest;
+};
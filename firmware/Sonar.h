@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include "ev3cxx.h"
+#include "PeriodicLoop.h"
+
+
+struct SonarReading
+{
+	int16_t cm;
+	uint32_t timeUs;  // when the ping was taken
+	bool stale;       // no fresh ping for longer than the staleness limit
+};
+
+
+// Pings the ultrasonic sensors from their own task at the rate the sensors can
+// deliver and publishes the last distance of each, so the control loops never wait
+// for a ping. With two sensors the pings alternate, one sensor per sample() call,
+// so they do not hear each other's echo.
+// sample() is the only writer and read() the only reader; every reading is guarded
+// by a sequence counter, which is odd while an update is in progress.
+class SonarService
+{
+public:
+	static const int MAX_SENSORS = 2;
+
+
+	SonarService( ev3cxx::UltrasonicSensor& sonar, uint32_t staleMs = 100 )
+			: SonarService( sonar, nullptr, staleMs ) { }
+
+
+	SonarService( ev3cxx::UltrasonicSensor& first, ev3cxx::UltrasonicSensor* second, uint32_t staleMs )
+			: _count( second ? 2 : 1 ), _next( 0 ), _staleUs( staleMs * 1000 )
+	{
+		_channels[ 0 ].sonar = &first;
+		_channels[ 1 ].sonar = second;
+	}
+
+
+	// Called periodically from sonar_task
+	void sample( )
+	{
+		Channel& c = _channels[ _next ];
+		_next = _next + 1 == _count ? 0 : _next + 1;
+
+		int16_t cm = static_cast< int16_t >( c.sonar->centimeters() );
+		uint32_t time = nowUs();
+		uint32_t seq = c.seq.load( std::memory_order_relaxed );
+		c.seq.store( seq + 1, std::memory_order_release );
+		c.cm = cm;
+		c.timeUs = time;
+		c.seq.store( seq + 2, std::memory_order_release );
+	}
+
+
+	// Constant time: the reader may preempt sample() in the middle of an update and
+	// cannot wait for it to finish, so it falls back to the last consistent reading
+	SonarReading read( int sensor = 0 )
+	{
+		Channel& c = _channels[ sensor ];
+		uint32_t before = c.seq.load( std::memory_order_acquire );
+		int16_t cm = c.cm;
+		uint32_t time = c.timeUs;
+		uint32_t after = c.seq.load( std::memory_order_acquire );
+		if ( before == after && !( before & 1 ) && before != 0 ) {
+			c.last.cm = cm;
+			c.last.timeUs = time;
+			c.valid = true;
+		}
+		// Every sensor is pinged once per _count samples
+		c.last.stale = !c.valid || nowUs() - c.last.timeUs > _staleUs * _count;
+		return c.last;
+	}
+
+
+	int sensorCount( ) const
+	{
+		return _count;
+	}
+
+
+private:
+	struct Channel
+	{
+		Channel( ) : sonar( nullptr ), seq( 0 ), cm( 255 ), timeUs( 0 ), last{ 255, 0, true }, valid( false ) { }
+
+		ev3cxx::UltrasonicSensor* sonar;
+
+		std::atomic < uint32_t > seq;
+		volatile int16_t cm;
+		volatile uint32_t timeUs;
+
+		// reader side
+		SonarReading last;
+		bool valid;
+	};
+
+
+	Channel _channels[ MAX_SENSORS ];
+	int _count;
+	int _next;
+	uint32_t _staleUs;
+};
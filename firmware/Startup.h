@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+
+#include "ev3cxx.h"
+#include "PeriodicLoop.h"
+
+#include <libs/logging/logging.hpp>
+
+
+// Runs independent initialisation phases concurrently, each in its own startup
+// task, and reports how long every phase took. The startup tasks share one
+// priority, so they switch only when a phase blocks and may use the logger.
+class Startup
+{
+public:
+	static const int SLOTS = 2;
+
+
+	Startup( Logger& log, const ID ( &tasks )[ SLOTS ] )
+			: _log( log ), _tasks( tasks ), _count( 0 ), _startUs( nowUs() ) { }
+
+
+	// Starts fn in the next free startup task. Phases which are not required are
+	// not waited for by join().
+	void spawn( const char* name, std::function < void( ) > fn, bool required = true )
+	{
+		assert( _count < SLOTS );
+		Phase& p = _phases[ _count ];
+		p.name = name;
+		p.fn = fn;
+		p.required = required;
+		p.done.store( false, std::memory_order_relaxed );
+		act_tsk( _tasks[ _count ] );
+		_count++;
+	}
+
+
+	// Body of the startup task with the given slot
+	void runSlot( int slot )
+	{
+		Phase& p = _phases[ slot ];
+		p.startUs = nowUs();
+		p.fn();
+		p.endUs = nowUs();
+		// Log before done, join() may return and the main task use the logger then
+		_log.logInfo( "START", "{} {} ms" ) << p.name << ( p.endUs - p.startUs ) / 1000;
+		p.done.store( true, std::memory_order_release );
+	}
+
+
+	void join( )
+	{
+		for ( int i = 0; i != _count; i++ ) {
+			while ( _phases[ i ].required && !_phases[ i ].done.load( std::memory_order_acquire ) )
+				ev3cxx::delayMs( 5 );
+		}
+		_log.logInfo( "START", "ready {} ms" ) << ( nowUs() - _startUs ) / 1000;
+	}
+
+
+private:
+	struct Phase
+	{
+		const char* name;
+		std::function < void( ) > fn;
+		bool required;
+		uint32_t startUs;
+		uint32_t endUs;
+		std::atomic < bool > done;
+	};
+
+
+	Logger& _log;
+	const ID ( &_tasks )[ SLOTS ];
+	Phase _phases[ SLOTS ];
+	int _count;
+	uint32_t _startUs;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+
+#include <atoms/container/spsc_ring.h>
+#include <atoms/communication/schema.h>
+
+#include "ev3cxx.h"
+
+
+// Binary telemetry channel. The control loop serializes whole frames into a ring
+// buffer with post(); a low-priority task writes the buffered bytes to Bluetooth
+// in blocks with flush(). When the link cannot keep up and the buffer fills, new
+// frames are dropped whole and counted, so the control loop never waits.
+class Telemetry
+{
+public:
+	static const size_t BUFFER_SIZE = 4096;
+
+
+	Telemetry( )
+			: _out( nullptr ), _frames( 0 ), _drops( 0 ) { }
+
+
+	// Opens the Bluetooth serial port; until then all data is discarded
+	void open( )
+	{
+		_out = ev3_serial_open_file( EV3_SERIAL_BT );
+	}
+
+
+	// Control loop; returns false if the frame was dropped
+	bool post( const void* data, size_t size )
+	{
+		if ( !_ring.push_n( static_cast< const uint8_t* >( data ), size ) ) {
+			_drops.store( _drops.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+			return false;
+		}
+		_frames.store( _frames.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+		return true;
+	}
+
+
+	template < typename Packet >
+	bool post( const Packet& packet )
+	{
+		return post( packet.raw(), packet.raw_size() );
+	}
+
+
+	// Frame with a payload scattered over several buffers, posted whole or dropped
+	template < size_t N >
+	bool post( const atoms::Gather < N >& frame )
+	{
+		// only the producer adds data, so the free space cannot shrink meanwhile
+		if ( _ring.capacity() - _ring.size() < frame.size() ) {
+			_drops.store( _drops.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+			return false;
+		}
+		for ( const atoms::Segment& s : frame.parts )
+			_ring.push_n( static_cast< const uint8_t* >( s.data ), s.size );
+		_frames.store( _frames.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+		return true;
+	}
+
+
+	// Serializes a record of an atoms::Schema, e.g. send< tlm::MotorsLine >( l, r, e )
+	template < typename Schema, typename... Fields >
+	bool send( const Fields&... fields )
+	{
+		uint8_t frame[ Schema::size ];
+		Schema::encode( frame, fields... );
+		return post( frame, Schema::size );
+	}
+
+
+	// Called periodically from telemetry_task
+	void flush( )
+	{
+		bool connected = _out && ev3_bluetooth_is_connected();
+		const uint8_t* block;
+		size_t size;
+		while ( ( size = _ring.peek_block( block ) ) != 0 ) {
+			if ( connected )
+				std::fwrite( block, 1, size, _out );
+			_ring.skip( size );
+		}
+		if ( connected )
+			std::fflush( _out );
+	}
+
+
+	uint32_t frameCount( ) const
+	{
+		return _frames.load( std::memory_order_relaxed );
+	}
+
+
+	uint32_t dropCount( ) const
+	{
+		return _drops.load( std::memory_order_relaxed );
+	}
+
+
+private:
+	FILE* _out;
+	atoms::SpscRing < uint8_t, BUFFER_SIZE > _ring;
+	// written by the control loop only
+	std::atomic < uint32_t > _frames;
+	std::atomic < uint32_t > _drops;
+};
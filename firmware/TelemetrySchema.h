@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atoms/communication/schema.h>
+
+
+// Records sent over Bluetooth with Debug::Packet. The command numbers and field
+// types are what the Lorris analyzer session (Lorris-analyzer_test-session.cldta)
+// expects, so keep them in sync when changing a record.
+namespace tlm
+{
+	// calibrated left, calibrated right, their sum, errorNeg
+	using ColorSensors = atoms::Schema < atoms::AvakarFrame < 0 >, uint8_t, uint8_t, uint8_t, int8_t >;
+
+	// left speed, right speed, errorNeg of the line regulator
+	using MotorsLine = atoms::Schema < atoms::AvakarFrame < 1 >, int16_t, int16_t, int16_t >;
+
+	// parameter id, value; sent when a tuned parameter is applied or asked for.
+	// Commands 2 to 4 are color_rgb and the ultrasonic channels of the session.
+	using Parameter = atoms::Schema < atoms::AvakarFrame < 5 >, uint8_t, int32_t >;
+}
+
+
+// Commands received over Bluetooth, see CommandChannel
+namespace cmd
+{
+	// parameter id, value; applied between motion primitives
+	using SetParameter = atoms::Schema < atoms::AvakarFrame < 0 >, uint8_t, int32_t >;
+
+	// parameter id or ParameterRegistry::ALL; the value is sent back as tlm::Parameter
+	using GetParameter = atoms::Schema < atoms::AvakarFrame < 1 >, uint8_t >;
+}
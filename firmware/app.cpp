@@ -5,6 +5,7 @@
  */
 
 #include <cstdlib>
+#include <csignal>
 #include <cmath>
 #include <string>
 #include <fstream>
@@ -27,7 +28,13 @@
 #include "libs/logging/DisplayLogSink.h"
 #include "libs/logging/BTLogSink.h"
 
+#include "Sensors.h"
+#include "Startup.h"
+#include "Telemetry.h"
+#include "CommandChannel.h"
+#include "FlightRecorder.h"
 #include "Robot.h"
+#include "RobotConfig.h"
 #include "Detector.h"
 #include "ketchup.hpp"
 
@@ -38,28 +45,6 @@ using ev3cxx::display;
 using ev3cxx::format;
 
 
-void calibrateSensor( int val, int& min, int& max )
-{
-	if ( max < val )
-		max = val;
-	if ( min > val )
-		min = val;
-}
-
-
-int getCalibratedValue( int val, int vMin, int vMax, int min, int max, bool clamp = false )
-{
-	int result = ( ( val - vMin ) * ( float( max - min ) / ( vMax - vMin ) ) ) + min;
-	if ( clamp ) {
-		if ( min > result )
-			return min;
-		if ( max < result )
-			return max;
-	}
-	return result;
-}
-
-
 void waitForButton( ev3cxx::BrickButton& btn, Logger& l, std::string msg, bool skip = false,
                     std::function < void( ) > idleTask = [ ] { } )
 {
@@ -91,19 +76,78 @@ void display_intro( json11::Json config, ev3cxx::detail::Display& display )
 }
 
 
-json11::Json load_config( std::string fileName )
+Logger l;
+char welcomeString[] = "\r\tK-ranka 2017\nev3cxx-ketchup\nInitialization...\n";
+SensorSampler* sensorSampler = nullptr;
+Robot* actuatedRobot = nullptr;
+SonarService* sonarService = nullptr;
+Telemetry telemetry;
+CommandChannel* commandChannel = nullptr;
+FlightRecorder recorder;
+Startup* startup = nullptr;
+
+
+void sensor_task( intptr_t unused )
 {
-	std::ifstream configFile( fileName );
-	std::string configJson( ( std::istreambuf_iterator < char >( configFile ) ),
-	                        std::istreambuf_iterator < char >() );
+	PeriodicLoop loop( PERIOD_SENSOR_TASK * 1000 );
+	loop.run( [ ] {
+		sensorSampler->sample();
+		return true;
+	} );
+}
 
-	std::string ErrorMsg = std::string( "Json parsing error" );
-	return json11::Json::parse( configJson, ErrorMsg );
+
+void actuator_task( intptr_t unused )
+{
+	PeriodicLoop loop( PERIOD_ACTUATOR_TASK * 1000 );
+	loop.run( [ ] {
+		actuatedRobot->updateActuators();
+		return true;
+	} );
 }
 
 
-Logger l;
-char welcomeString[] = "\r\tK-ranka 2017\nev3cxx-ketchup\nInitialization...\n";
+void sonar_task( intptr_t unused )
+{
+	PeriodicLoop loop( PERIOD_SONAR_TASK * 1000 );
+	loop.run( [ ] {
+		sonarService->sample();
+		return true;
+	} );
+}
+
+
+void telemetry_task( intptr_t unused )
+{
+	PeriodicLoop loop( PERIOD_TELEMETRY_TASK * 1000 );
+	loop.run( [ ] {
+		telemetry.flush();
+		return true;
+	} );
+}
+
+
+void command_task( intptr_t unused )
+{
+	while ( true ) {
+		if ( !commandChannel->receive() )
+			ev3cxx::delayMs( 100 );
+	}
+}
+
+
+void startup_task( intptr_t slot )
+{
+	startup->runSlot( slot );
+}
+
+
+// A failed assert aborts without Robot::exit()
+void dump_flight_recorder( int )
+{
+	if ( actuatedRobot )
+		actuatedRobot->dumpFlightRecorder();
+}
 
 
 void destroyEnemy(ev3cxx::StopWatch stopWatch, int time, Robot& robot, KetchupLogic* controller){
@@ -156,8 +200,12 @@ void main_task( intptr_t unused )
 	ev3cxx::Motor motorSensor{ ev3cxx::MotorPort::B, ev3cxx::MotorType::MEDIUM };
 	motorSensor.off();
 
+	SensorSampler sampler{ colorL, colorR, ketchupSensor, motors };
+	sensorSampler = &sampler;
+	SonarService sonarSampler{ sonar, 3 * PERIOD_SONAR_TASK };
+	sonarService = &sonarSampler;
+
 	json11::Json config = load_config( "config.json" );
-	display_intro( config, display );
 
 	// format(bt, "\n\n% ") % welcomeString;
 	// display.format("% ") % welcomeString;
@@ -165,10 +213,35 @@ void main_task( intptr_t unused )
 
 	auto robot = std::make_unique < Robot >( robotGeometry, colorL, colorR, ketchupSensor, btnEnter, btnStop, motors,
 	                                         motorGate,
-	                                         l, bt, sonar, motorSensor,
+	                                         l, bt, sonarSampler, motorSensor, sampler, recorder,
 	                                         Robot::Debug( Robot::Debug::Text | Robot::Debug::Packet ) );
-	auto controller = std::make_unique < KetchupLogic >( * robot );
+	load_line_follower( config, * robot );
+	json11::Json gridMm = config[ "field" ][ "gridMm" ];
+	auto controller = std::make_unique < KetchupLogic >( * robot, gridMm.is_number() ? gridMm.int_value() : 280 );
 	robot->ledRed();
+	actuatedRobot = robot.get();
+	std::signal( SIGABRT, dump_flight_recorder );
+	act_tsk( ACTUATOR_TASK );
+	act_tsk( SONAR_TASK );
+	telemetry.open();
+	robot->telemetry = &telemetry;
+	act_tsk( TELEMETRY_TASK );
+	CommandChannel commands{ robot->parameters };
+	commandChannel = &commands;
+	commands.open();
+	act_tsk( COMMAND_TASK );
+
+	// The intro redraws the screen the log is shown on, so it runs alone. The gate
+	// and arm homing uses only the gate and arm motors and the calibration the drive
+	// motors and the colour sensors, so they run at once.
+	display_intro( config, display );
+	static const ID startupTasks[ Startup::SLOTS ] = { STARTUP_TASK_1, STARTUP_TASK_2 };
+	Startup boot( l, startupTasks );
+	startup = &boot;
+	boot.spawn( "init", [ & ] { robot->init(); } );
+	boot.spawn( "calibrate", [ & ] { robot->calibrateSensor(); } );
+	boot.join();
+	act_tsk( SENSOR_TASK );
 
 	// waitForButton(btnEnter, l, "Testing components", false, [&]{
 	//     l.logDebug("TESTING", "ketchupSensor: {}") << ketchupSensor.isPressed();
@@ -177,15 +250,9 @@ void main_task( intptr_t unused )
 
 //	ev3cxx::delayMs( 1000 );
 
-	l.logInfo( "ROBOT", "init() - start" );
-	robot->init();
-	l.logInfo( "ROBOT", "init() - end" );
-
-	//l.logInfo("ROBOT", "calibrate() - start");
-	robot->calibrateSensor();
-	//l.logInfo("ROBOT", "calibrate() - end");
 	while ( !btnEnter.isPressed() ) {
 		ev3cxx::delayMs( 200 );
+		robot->safePoint();
 		if ( !ketchupSensor.isPressed() )
 			robot->ledOrange();
 		else
@@ -284,4 +351,5 @@ void main_task( intptr_t unused )
 
 //	robot->exit(1);
 	motors.off( true );
+	robot->logLoopStats();
 }
@@ -72,6 +72,10 @@ extern "C" {
 #define MID_PRIORITY		(TMIN_APP_TPRI + 3)
 #define LOW_PRIORITY		(TMIN_APP_TPRI + 4)
 
+/* Above main_task, so a busy main loop cannot delay sampling and overflow the
+   sensor ring; a sample is a fixed number of reads and a push, so it is short */
+#define PRIORITY_SENSOR_TASK	TMIN_APP_TPRI
+
 #define PRIORITY_PRD_TSK_1 TMIN_APP_TPRI
 #define PRIORITY_PRD_TSK_2 TMIN_APP_TPRI
 
@@ -80,6 +84,10 @@ extern "C" {
  */
 //#define PERIOD_PRD_TSK_1  (100)
 //#define PERIOD_PRD_TSK_2  (500)
+#define PERIOD_SENSOR_TASK  (2)
+#define PERIOD_ACTUATOR_TASK  (10)
+#define PERIOD_SONAR_TASK  (30)
+#define PERIOD_TELEMETRY_TASK  (20)
 
 /**
  * Default task stack size in bytes
@@ -96,6 +104,12 @@ extern "C" {
 #ifndef TOPPERS_MACRO_ONLY
 
 extern void	main_task(intptr_t);
+extern void	sensor_task(intptr_t);
+extern void	actuator_task(intptr_t);
+extern void	sonar_task(intptr_t);
+extern void	telemetry_task(intptr_t);
+extern void	command_task(intptr_t);
+extern void	startup_task(intptr_t);
 // extern void periodic_task_1(intptr_t);
 // extern void periodic_task_2(intptr_t);
 
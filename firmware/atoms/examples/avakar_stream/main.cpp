@@ -0,0 +1,38 @@
+#include <atoms/communication/avakar_stream.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+
+// This example demonstrates usage of AvakarStream class. It splits a file with
+// captured Avakar packets (or standard input) into packets and prints how many
+// packets of each command it contains.
+
+using namespace atoms;
+
+int main(int argc, char** argv) {
+    std::ifstream file;
+    if (argc > 1)
+        file.open(argv[1], std::ios::binary);
+    std::istream& in = argc > 1 ? file : std::cin;
+
+    AvakarStream stream;
+    size_t counts[16] = {};
+    auto count = [&](const AvakarView& p) {
+        counts[p.command()]++;
+    };
+
+    std::vector<char> buffer(1 << 16);
+    while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+        stream.decode(reinterpret_cast<const uint8_t*>(buffer.data()), in.gcount(), count);
+    stream.finish(count);
+
+    for (int i = 0; i != 16; i++)
+        if (counts[i])
+            std::cout << "Command " << i << ": " << counts[i] << " packets\n";
+    std::cout << "Skipped bytes: " << stream.skipped() << "\n";
+    std::cout << "Resyncs:       " << stream.resyncs() << "\n";
+}
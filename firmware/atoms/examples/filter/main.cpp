@@ -0,0 +1,23 @@
+#include <atoms/numeric/filter.h>
+#include <iostream>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+
+// This example demonstrates usage of the storage-free filters
+
+using namespace atoms;
+
+int main() {
+    std::cout << "=== Exponential filter ===\n";
+    ExpFilter<int, 2> exp;
+    for (int i = 0; i != 6; i++)
+        std::cout << "Push 100: " << exp.push(100) << "\n";
+    std::cout << "Push -5:  " << exp.push(-5) << "\n";
+
+    std::cout << "=== Debounce ===\n";
+    Debounce<3> debounce;
+    for (bool b : { true, false, true, true, true, false, false, false })
+        std::cout << "Push " << b << ": " << debounce.push(b) << "\n";
+}
@@ -0,0 +1,48 @@
+#include <atoms/communication/schema.h>
+#include <iostream>
+#include <iomanip>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+
+// This example demonstrates usage of Schema class. A record is declared once
+// as a list of types; its layout is computed at compile time and the same
+// declaration is used for encoding and decoding.
+
+using namespace atoms;
+
+void dump(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i != size; i++)
+        std::cout << std::hex << std::setw(2) << std::setfill('0') << int(data[i]) << " ";
+    std::cout << std::dec << "\n";
+}
+
+int main() {
+    // Avakar packet with command 1 and three 16bit numbers
+    using Motors = Schema<AvakarFrame<1>, int16_t, int16_t, int16_t>;
+
+    std::cout << "=== Fixed record ===\n";
+    std::cout << "Frame size:      " << Motors::size << "\n";
+    std::cout << "Offset of third: " << Motors::offset<2>() << "\n";
+    uint8_t frame[Motors::size];
+    Motors::encode(frame, 100, -100, 42);
+    std::cout << "Encoded:         ";
+    dump(frame, sizeof(frame));
+
+    int16_t left, right, error;
+    if (Motors::decode(frame, sizeof(frame), left, right, error))
+        std::cout << "Decoded:         " << left << " " << right << " " << error << "\n";
+
+    std::cout << "=== Record with unbounded payload ===\n";
+    // 16bit size allows payloads longer than 15 bytes. The payload is not
+    // copied, the encoder returns the list of buffers forming the frame.
+    using Log = Schema<SizedFrame<2>, uint32_t>;
+    const char text[] = "Hello from the robot";
+    Segment payload[] = { { text, sizeof(text) - 1 } };
+    uint8_t head[Log::size];
+    auto g = Log::encode(head, payload, 1234);
+    std::cout << "Parts: " << g.count << ", size: " << g.size() << "\n";
+    for (const Segment& s : g.parts)
+        dump(static_cast<const uint8_t*>(s.data), s.size);
+}
@@ -0,0 +1,38 @@
+#include <atoms/container/spsc_ring.h>
+#include <iostream>
+#include <thread>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+
+// This example demonstrates passing samples from a producer thread to a
+// consumer thread without locks
+
+using namespace atoms;
+
+struct Sample {
+    int time;
+    int value;
+};
+
+int main() {
+    SpscRing<Sample, 8> ring;
+
+    std::thread producer([&] {
+        for (int i = 0; i != 20; ) {
+            if (ring.push({ i, i * i }))
+                i++;
+        }
+    });
+
+    int received = 0;
+    while (received != 20) {
+        Sample s;
+        if (ring.pop(s)) {
+            std::cout << "t = " << s.time << ": " << s.value << "\n";
+            received++;
+        }
+    }
+    producer.join();
+}
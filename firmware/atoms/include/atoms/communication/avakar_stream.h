@@ -0,0 +1,179 @@
+#pragma once
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace atoms {
+
+// Complete Avakar packet inside a decoded buffer; nothing is copied. See
+// AvakarStream::decode for how long the view stays valid.
+struct AvakarView {
+    const uint8_t* raw;
+
+    uint8_t command() const {
+        return raw[1] >> 4;
+    }
+
+    // size of the data part
+    uint8_t size() const {
+        return raw[1] & 0xF;
+    }
+
+    // size of the whole packet, e.g. for Schema::decode(v.raw, v.raw_size(), ...)
+    size_t raw_size() const {
+        return 2 + size();
+    }
+
+    const uint8_t* data() const {
+        return raw + 2;
+    }
+
+    // no range check, see size()
+    template <class T>
+    T get(size_t index) const {
+        T t;
+        memcpy(&t, data() + index, sizeof(T));
+        return t;
+    }
+};
+
+// Splits a byte stream (e.g. captured Bluetooth traffic or a file) into Avakar
+// packets. Unlike AvakarPacket::push_byte it works on whole buffers: the 0x80
+// sync bytes are found by memchr, which is vectorised in common C libraries, and
+// the packets are handed out as views into the buffer.
+//
+// Avakar packets carry no checksum, so a packet is accepted only when the byte
+// following it is 0x80 again and, if an expected size is registered for its
+// command, the size matches. Otherwise the candidate is dropped and the
+// search continues at the next 0x80, so the decoder resynchronises after
+// garbage or lost bytes. A packet at the end of a buffer is kept until the next
+// decode() call reveals the following byte, or until finish().
+class AvakarStream {
+public:
+    AvakarStream() : pending(0), packet_count(0), skipped_count(0), resync_count(0) {
+        for (int& s : expected)
+            s = -1;
+    }
+
+    // accept only packets of given data size for the command
+    void expect(uint8_t command, uint8_t size) {
+        expected[command & 0xF] = size;
+    }
+
+    // expected size from a Schema with AvakarFrame
+    template <class Schema>
+    void expect() {
+        expect(Schema::frame::command, Schema::data_size);
+    }
+
+    // Calls f(AvakarView) for every complete packet in the data. The views are
+    // valid only during the call of f; they point to the data or, for packets
+    // split between two decode() calls, to an internal buffer.
+    template <class F>
+    void decode(const uint8_t* data, size_t size, F&& f) {
+        size_t start = 0;
+        if (pending) {
+            // join the unfinished packet with the beginning of the new data
+            uint8_t joined[2 * MAX_CANDIDATE];
+            size_t taken = size < MAX_CANDIDATE ? size : MAX_CANDIDATE;
+            memcpy(joined, carry, pending);
+            memcpy(joined + pending, data, taken);
+            size_t stop = scan(joined, pending + taken, false, f);
+            if (stop < pending) {
+                // not enough new data to complete the packet
+                memmove(carry, joined + stop, pending + taken - stop);
+                pending = pending + taken - stop;
+                return;
+            }
+            start = stop - pending;
+            pending = 0;
+        }
+        size_t stop = start + scan(data + start, size - start, false, f);
+        pending = size - stop;
+        memcpy(carry, data + stop, pending);
+    }
+
+    // End of the stream; the last packet is accepted without the following
+    // sync byte, an incomplete one is dropped
+    template <class F>
+    void finish(F&& f) {
+        scan(carry, pending, true, f);
+        pending = 0;
+    }
+
+    // Drops the unfinished packet, e.g. when a new capture begins
+    void reset() {
+        pending = 0;
+    }
+
+    // number of accepted packets
+    size_t packets() const { return packet_count; }
+    // number of bytes outside of accepted packets
+    size_t skipped() const { return skipped_count; }
+    // number of rejected packet candidates
+    size_t resyncs() const { return resync_count; }
+
+private:
+    // header, 15 bytes of data and the following sync byte
+    constexpr static size_t MAX_CANDIDATE = 2 + 15 + 1;
+
+    // returns the position of an unfinished packet at the end of the data
+    template <class F>
+    size_t scan(const uint8_t* data, size_t size, bool last, F& f) {
+        size_t pos = 0;
+        while (pos != size) {
+            const void* sync = memchr(data + pos, 0x80, size - pos);
+            if (!sync) {
+                skipped_count += size - pos;
+                return size;
+            }
+            size_t s = static_cast<const uint8_t*>(sync) - data;
+            skipped_count += s - pos;
+            pos = s;
+
+            if (size - s < 2) {
+                if (!last)
+                    return s;
+                reject();
+                pos = s + 1;
+                continue;
+            }
+            AvakarView v{ data + s };
+            size_t end = s + v.raw_size();
+            if (end >= size && !last && (end > size || expected[v.command()] < 0 ||
+                                         expected[v.command()] == v.size()))
+                return s;
+            bool valid = end <= size
+                && (expected[v.command()] < 0 || expected[v.command()] == v.size())
+                && (end == size || data[end] == 0x80);
+            if (!valid) {
+                reject();
+                pos = s + 1;
+                continue;
+            }
+            f(v);
+            packet_count++;
+            pos = end;
+        }
+        return size;
+    }
+
+    void reject() {
+        resync_count++;
+        skipped_count++;
+    }
+
+    int expected[16];
+    uint8_t carry[MAX_CANDIDATE];
+    size_t pending;
+
+    size_t packet_count;
+    size_t skipped_count;
+    size_t resync_count;
+};
+
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+namespace atoms {
+
+// Typed records with a wire layout fixed at compile time. A record is declared
+// once as a list of field types:
+//
+//     using Motors = Schema<AvakarFrame<1>, int16_t, int16_t, int16_t>;
+//
+// The offsets of all fields are constants, so encoding is a sequence of
+// fixed-size stores into one contiguous buffer with no branches and no size
+// checks; the same declaration decodes the frame on the other end. Fields are
+// stored packed, in the byte order of the machine (little endian on ARM and x86).
+
+namespace schema_detail {
+
+template <class... Ts>
+struct packed_size {
+    constexpr static size_t value = 0;
+};
+
+template <class T, class... Ts>
+struct packed_size<T, Ts...> {
+    static_assert(std::is_trivially_copyable<T>::value,
+        "Schema fields have to be trivially copyable");
+    constexpr static size_t value = sizeof(T) + packed_size<Ts...>::value;
+};
+
+template <size_t I, class... Ts>
+struct packed_offset;
+
+template <class T, class... Ts>
+struct packed_offset<0, T, Ts...> {
+    constexpr static size_t value = 0;
+};
+
+template <size_t I, class T, class... Ts>
+struct packed_offset<I, T, Ts...> {
+    constexpr static size_t value = sizeof(T) + packed_offset<I - 1, Ts...>::value;
+};
+
+}
+
+// Part of a frame; a frame with an unbounded payload is written as a list of
+// segments, so the payload does not have to be copied next to the header
+struct Segment {
+    const void* data;
+    size_t size;
+};
+
+template <size_t N>
+struct Gather {
+    constexpr static size_t count = N;
+
+    size_t size() const {
+        size_t s = 0;
+        for (const Segment& p : parts)
+            s += p.size;
+        return s;
+    }
+
+    Segment parts[N];
+};
+
+template <size_t N>
+constexpr size_t Gather<N>::count;
+
+// Avakar packet framing (see avakar.h):
+//     0x80 (8bit), size (4bit), command (4bit), data (up to 15 bytes)
+template <uint8_t COMMAND>
+struct AvakarFrame {
+    static_assert(COMMAND < 16, "Avakar command has only 4 bits");
+
+    constexpr static uint8_t command     = COMMAND;
+    constexpr static size_t header_size  = 2;
+    constexpr static size_t max_data_size = 15;
+    constexpr static bool unbounded       = false;
+
+    static void write_header(uint8_t* out, size_t data_size) {
+        out[0] = 0x80;
+        out[1] = uint8_t(COMMAND << 4 | data_size);
+    }
+
+    // returns size of the data or -1 if the header does not belong to the frame
+    static int read_header(const uint8_t* in, size_t size) {
+        if (size < header_size || in[0] != 0x80 || in[1] >> 4 != COMMAND)
+            return -1;
+        return in[1] & 0xF;
+    }
+};
+
+// Framing with 16bit size for larger or unbounded records:
+//     0x80 (8bit), command (8bit), size (16bit, little endian), data
+// It is the layout of Packet<StaticU8<0x80>, CommandU8, SizeU16, BoundedData<...>>
+// from packet.h, so either side can be replaced by a generic Packet.
+template <uint8_t COMMAND>
+struct SizedFrame {
+    constexpr static uint8_t command     = COMMAND;
+    constexpr static size_t header_size  = 4;
+    constexpr static size_t max_data_size = 0xFFFF;
+    constexpr static bool unbounded       = true;
+
+    static void write_header(uint8_t* out, size_t data_size) {
+        out[0] = 0x80;
+        out[1] = COMMAND;
+        out[2] = uint8_t(data_size);
+        out[3] = uint8_t(data_size >> 8);
+    }
+
+    static int read_header(const uint8_t* in, size_t size) {
+        if (size < header_size || in[0] != 0x80 || in[1] != COMMAND)
+            return -1;
+        return in[2] | in[3] << 8;
+    }
+};
+
+template <class Frame, class... Fields>
+class Schema {
+public:
+    using Record = std::tuple<Fields...>;
+    using frame  = Frame;
+
+    template <size_t I>
+    using type = typename std::tuple_element<I, Record>::type;
+
+    constexpr static size_t field_count = sizeof...(Fields);
+    // size of the fields without the frame header
+    constexpr static size_t data_size   = schema_detail::packed_size<Fields...>::value;
+    // size of the whole frame without an unbounded payload
+    constexpr static size_t size        = Frame::header_size + data_size;
+
+    static_assert(data_size <= Frame::max_data_size, "Record does not fit the frame");
+
+    // position of the I-th field in the frame
+    template <size_t I>
+    constexpr static size_t offset() {
+        return Frame::header_size + schema_detail::packed_offset<I, Fields...>::value;
+    }
+
+    // serializes the record to out, which has to hold size bytes; returns size
+    static size_t encode(uint8_t* out, const Fields&... fields) {
+        Frame::write_header(out, data_size);
+        store_all(out, std::index_sequence_for<Fields...>(), fields...);
+        return size;
+    }
+
+    // serializes the header and fields to head (size bytes) and appends the
+    // payload segments as they are, without copying them. The payload size is
+    // not checked against Frame::max_data_size.
+    template <size_t N>
+    static Gather<N + 1> encode(uint8_t* head, const Segment (&payload)[N],
+        const Fields&... fields)
+    {
+        static_assert(Frame::unbounded, "Frame cannot carry an unbounded payload");
+        Gather<N + 1> g;
+        g.parts[0] = { head, size };
+        size_t payload_size = 0;
+        for (size_t i = 0; i != N; i++) {
+            g.parts[i + 1] = payload[i];
+            payload_size += payload[i].size;
+        }
+        Frame::write_header(head, data_size + payload_size);
+        store_all(head, std::index_sequence_for<Fields...>(), fields...);
+        return g;
+    }
+
+    // true if the frame of given size is a complete frame of this schema
+    static bool matches(const uint8_t* frame, size_t frame_size) {
+        int d = Frame::read_header(frame, frame_size);
+        return d >= int(data_size) && Frame::header_size + d == frame_size;
+    }
+
+    // deserializes the fields of a frame, returns false if the frame does not
+    // match the schema
+    static bool decode(const uint8_t* frame, size_t frame_size, Fields&... fields) {
+        if (!matches(frame, frame_size))
+            return false;
+        load_all(frame, std::index_sequence_for<Fields...>(), fields...);
+        return true;
+    }
+
+    static bool decode(const uint8_t* frame, size_t frame_size, Record& record) {
+        return decode_tuple(frame, frame_size, record, std::index_sequence_for<Fields...>());
+    }
+
+    // single field of a matching frame
+    template <size_t I>
+    static type<I> get(const uint8_t* frame) {
+        type<I> t;
+        std::memcpy(&t, frame + offset<I>(), sizeof(t));
+        return t;
+    }
+
+    // the unbounded payload following the fields of a matching frame
+    static const uint8_t* payload(const uint8_t* frame) {
+        return frame + size;
+    }
+
+    static size_t payload_size(const uint8_t* frame) {
+        return Frame::read_header(frame, Frame::header_size) - data_size;
+    }
+
+private:
+    template <size_t... I>
+    static void store_all(uint8_t* out, std::index_sequence<I...>, const Fields&... fields) {
+        int expand[] = { 0, (std::memcpy(out + offset<I>(), &fields, sizeof(Fields)), 0)... };
+        (void) expand;
+    }
+
+    template <size_t... I>
+    static void load_all(const uint8_t* in, std::index_sequence<I...>, Fields&... fields) {
+        int expand[] = { 0, (std::memcpy(&fields, in + offset<I>(), sizeof(Fields)), 0)... };
+        (void) expand;
+    }
+
+    template <size_t... I>
+    static bool decode_tuple(const uint8_t* frame, size_t frame_size, Record& record,
+        std::index_sequence<I...>)
+    {
+        return decode(frame, frame_size, std::get<I>(record)...);
+    }
+};
+
+template <class Frame, class... Fields>
+constexpr size_t Schema<Frame, Fields...>::field_count;
+template <class Frame, class... Fields>
+constexpr size_t Schema<Frame, Fields...>::data_size;
+template <class Frame, class... Fields>
+constexpr size_t Schema<Frame, Fields...>::size;
+
+}
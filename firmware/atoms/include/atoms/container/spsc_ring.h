@@ -0,0 +1,107 @@
+#pragma once
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <cstddef>
+#include <atomic>
+
+namespace atoms {
+
+// Lock-free ring buffer for exactly one producer and one consumer (e.g. a
+// sampling task and a control loop). SIZE has to be a power of two; indices
+// run freely and are masked on access, so all SIZE slots are usable. No
+// dynamic memory is used.
+template <class T, size_t SIZE>
+class SpscRing {
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0,
+        "SpscRing size has to be a power of two");
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // producer: appends an item, returns false (and drops the item) if the
+    // buffer is full
+    bool push(const T& t) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == SIZE)
+            return false;
+        values[h & MASK] = t;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer: appends all n items or none of them, so that e.g. a serialized
+    // frame is never split by a full buffer
+    bool push_n(const T* data, size_t n) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (SIZE - (h - tail.load(std::memory_order_acquire)) < n)
+            return false;
+        for (size_t i = 0; i != n; i++)
+            values[(h + i) & MASK] = data[i];
+        head.store(h + n, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: retrieves the oldest item, returns false if the buffer is empty
+    bool pop(T& t) {
+        size_t tl = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == tl)
+            return false;
+        t = values[tl & MASK];
+        tail.store(tl + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: pointer to the oldest item or nullptr; the item stays valid
+    // until it is released by pop() or skip()
+    const T* peek() const {
+        size_t tl = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == tl)
+            return nullptr;
+        return &values[tl & MASK];
+    }
+
+    // consumer: the oldest items which are contiguous in memory, so they can be
+    // handed to e.g. fwrite at once; returns their count. Release them by skip().
+    size_t peek_block(const T*& data) const {
+        size_t tl = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - tl;
+        size_t to_end = SIZE - (tl & MASK);
+        data = &values[tl & MASK];
+        return available < to_end ? available : to_end;
+    }
+
+    // consumer: drops up to n oldest items
+    void skip(size_t n = 1) {
+        size_t tl = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - tl;
+        tail.store(tl + (n < available ? n : available), std::memory_order_release);
+    }
+
+    // number of stored items; exact only when called from producer or consumer
+    size_t size() const {
+        return head.load(std::memory_order_acquire)
+            - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() == SIZE;
+    }
+
+    constexpr static size_t capacity() {
+        return SIZE;
+    }
+
+private:
+    constexpr static size_t MASK = SIZE - 1;
+
+    T values[SIZE];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+}
@@ -73,4 +73,87 @@ private:
     State  state;
 };
 
+// PID regulator with a low-pass filtered derivative term and integrator
+// anti-windup. Only +, -, * and comparisons are used, so it is suitable for
+// atoms::Fixed on targets without FPU.
+// The derivative is taken from the measurement (no kick on set-point change)
+// and filtered by first order IIR: d' = d' + d_filter * (d - d'), d_filter in
+// (0, 1], 1 means no filtering. The integrator is clamped to the output range
+// and it is not updated while the output is saturated in the direction of
+// the error.
+template <class T>
+class FilteredPid {
+public:
+    struct Config {
+        T p, i, d;
+        T d_filter;
+        T bottom, top;
+    };
+
+    struct State {
+        T integrator;
+        T derivative;
+        T last_input;
+        bool initialized;
+
+        State() : integrator(0), derivative(0), last_input(0), initialized(false) { }
+    };
+
+    FilteredPid(const Config& params) : params(params) {}
+
+    Config get_params() const {
+        return params;
+    }
+
+    void set_params(const Config& p) {
+        params = p;
+        reset();
+    }
+
+    State get_state() const {
+        return state;
+    }
+
+    void reset() {
+        state = State();
+    }
+
+    T step(T input, T desired_value) {
+        if (!state.initialized) {
+            state.last_input = input;
+            state.initialized = true;
+        }
+
+        T error = desired_value - input;
+        T raw_derivative = state.last_input - input;
+        state.derivative = state.derivative
+            + params.d_filter * (raw_derivative - state.derivative);
+        state.last_input = input;
+
+        T proportional = params.p * error;
+        T derivative = params.d * state.derivative;
+        T integrator = clamp(state.integrator + params.i * error);
+
+        T output = proportional + integrator + derivative;
+        bool windup = (output > params.top && error > T(0))
+            || (output < params.bottom && error < T(0));
+        if (!windup)
+            state.integrator = integrator;
+
+        return clamp(proportional + state.integrator + derivative);
+    }
+
+private:
+    T clamp(const T& value) const {
+        if (value > params.top)
+            return params.top;
+        if (value < params.bottom)
+            return params.bottom;
+        return value;
+    }
+
+    Config params;
+    State  state;
+};
+
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+#pragma once
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
+
+namespace atoms {
+
+// Exponential moving average with smoothing factor 2^-SHIFT:
+//     y += (x - y) / 2^SHIFT
+// The state is kept scaled by 2^SHIFT, so the update is one add and one shift and
+// no precision is lost for integral types. The response is roughly that of
+// a rolling average over 2^(SHIFT + 1) - 1 samples.
+template <class T, unsigned SHIFT>
+class ExpFilter {
+    static_assert(std::is_integral<T>::value, "ExpFilter works with integral types");
+    static_assert(SHIFT < sizeof(T) * 8 - 1, "SHIFT is too large for the type");
+public:
+    ExpFilter(T t = 0) { reset(t); }
+
+    T push(const T& t) {
+        acc += t - (acc >> SHIFT);
+        return get();
+    }
+
+    T get() const {
+        return acc >> SHIFT;
+    }
+
+    void reset(T t = 0) {
+        acc = t * (T(1) << SHIFT);
+    }
+
+private:
+    T acc;
+};
+
+// Two cascaded ExpFilters; the second order low-pass suppresses spikes better
+// than a single filter of the same delay.
+template <class T, unsigned SHIFT>
+class ExpFilter2 {
+public:
+    ExpFilter2(T t = 0) : first(t), second(t) {}
+
+    T push(const T& t) {
+        return second.push(first.push(t));
+    }
+
+    T get() const {
+        return second.get();
+    }
+
+    void reset(T t = 0) {
+        first.reset(t);
+        second.reset(t);
+    }
+
+private:
+    ExpFilter<T, SHIFT> first;
+    ExpFilter<T, SHIFT> second;
+};
+
+// Median of the last SIZE samples, removes outliers which would drag an average.
+// The window starts filled with the initial value.
+template <class T, size_t SIZE>
+class MedianFilter {
+    static_assert(SIZE % 2 == 1, "SIZE must be odd");
+public:
+    MedianFilter(T t = 0) { reset(t); }
+
+    T push(const T& t) {
+        values[index] = t;
+        index = index + 1 == SIZE ? 0 : index + 1;
+        std::array<T, SIZE> sorted = values;
+        std::nth_element(sorted.begin(), sorted.begin() + SIZE / 2, sorted.end());
+        median = sorted[SIZE / 2];
+        return median;
+    }
+
+    T get() const {
+        return median;
+    }
+
+    void reset(T t = 0) {
+        values.fill(t);
+        index = 0;
+        median = t;
+    }
+
+private:
+    std::array<T, SIZE> values;
+    size_t index;
+    T median;
+};
+
+// Rate of change per second of a sampled value, smoothed by ExpFilter. A rate is
+// taken only from two consecutive valid samples, so a value which jumps into the
+// valid region (e.g. an object appearing in front of a range finder) gives none;
+// an invalid sample starts the estimate over. Rates beyond maxRate either way are
+// physically implausible and dropped.
+template <unsigned SHIFT>
+class RateEstimator {
+public:
+    RateEstimator(int32_t maxRate = std::numeric_limits<int32_t>::max())
+        : maxRate(maxRate) { reset(); }
+
+    int32_t push(int32_t value, uint32_t timeUs, bool valid = true) {
+        if (!valid) {
+            reset();
+            return get();
+        }
+        uint32_t dt = timeUs - lastUs;
+        if (hasLast && dt) {
+            int64_t rate = (int64_t(value) - last) * 1000000 / dt;
+            if (rate >= -maxRate && rate <= maxRate)
+                filter.push(static_cast<int32_t>(rate));
+        }
+        last = value;
+        lastUs = timeUs;
+        hasLast = true;
+        return get();
+    }
+
+    int32_t get() const {
+        return filter.get();
+    }
+
+    void reset() {
+        filter.reset(0);
+        hasLast = false;
+        last = 0;
+        lastUs = 0;
+    }
+
+private:
+    ExpFilter<int32_t, SHIFT> filter;
+    int32_t maxRate;
+    int32_t last;
+    uint32_t lastUs;
+    bool hasLast;
+};
+
+// Integrating debouncer for binary signals. The counter moves towards the input
+// by one per sample and saturates at 0 and SAMPLES; the output changes only when
+// the counter reaches either end, so short glitches do not toggle it.
+template <unsigned SAMPLES>
+class Debounce {
+    static_assert(SAMPLES > 0 && SAMPLES < 256, "SAMPLES must fit to 8 bits");
+public:
+    Debounce(bool state = false) { reset(state); }
+
+    bool push(bool input) {
+        if (input) {
+            if (counter < SAMPLES && ++counter == SAMPLES)
+                state = true;
+        }
+        else {
+            if (counter > 0 && --counter == 0)
+                state = false;
+        }
+        return state;
+    }
+
+    bool get() const {
+        return state;
+    }
+
+    void reset(bool s = false) {
+        state = s;
+        counter = s ? SAMPLES : 0;
+    }
+
+private:
+    uint8_t counter;
+    bool state;
+};
+
+// Number of true samples among the last SIZE binary samples, the window is kept
+// as bits of a single word. Starts with a window of false samples.
+template <unsigned SIZE>
+class BitWindow {
+    static_assert(SIZE > 0 && SIZE <= 64, "SIZE must fit to 64 bits");
+public:
+    BitWindow() { reset(); }
+
+    unsigned push(bool input) {
+        if (bits >> (SIZE - 1) & 1)
+            ones--;
+        bits = (bits << 1 | input) & MASK;
+        ones += input;
+        return ones;
+    }
+
+    unsigned count() const {
+        return ones;
+    }
+
+    void reset() {
+        bits = 0;
+        ones = 0;
+    }
+
+private:
+    constexpr static uint64_t MASK = SIZE == 64 ? ~uint64_t(0) : (uint64_t(1) << SIZE % 64) - 1;
+
+    uint64_t bits;
+    unsigned ones;
+};
+
+}
@@ -97,7 +97,11 @@ public:
 	}
 
 	bool operator==(const Fixed& o) const {
-		return data = o.data;
+		return data == o.data;
+	}
+
+	bool operator!=(const Fixed& o) const {
+		return data != o.data;
 	}
 
 	bool operator<(const Fixed& o) const {
@@ -164,7 +168,7 @@ public:
 		return from_raw(data - o.data);
 	}
 
-	Fixed& operator-=(const Fixed& o) const {
+	Fixed& operator-=(const Fixed& o) {
 		data -= o.data;
 		return *this;
 	}
@@ -6,43 +6,216 @@
 #include <array>
 #include <initializer_list>
 #include <algorithm>
-#include <vector>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
 
 namespace atoms {
 
+namespace detail {
+
+constexpr bool is_power_of_two(size_t v) {
+    return v && !(v & (v - 1));
+}
+
+constexpr unsigned log2(size_t v) {
+    return v <= 1 ? 0 : 1 + log2(v / 2);
+}
+
+// Samples of a sliding window which can still become its extreme, oldest first.
+// For Compare = std::less the front is the minimum of the window, for
+// std::greater the maximum. Every sample is pushed and popped at most once.
+template <class T, size_t SIZE, class Compare>
+class MonotonicQueue {
+public:
+    MonotonicQueue() : head(0), count(0) {}
+
+    void push(const T& t, size_t seq) {
+        if (count && seq - seqs[head] >= SIZE) {
+            head = next(head);
+            count--;
+        }
+        while (count && !Compare()(values[last()], t))
+            count--;
+        size_t i = (head + count) % SIZE;
+        values[i] = t;
+        seqs[i] = seq;
+        count++;
+    }
+
+    const T& front() const {
+        return values[head];
+    }
+
+    void reset(const T& t, size_t seq) {
+        count = 0;
+        push(t, seq);
+    }
+
+private:
+    static size_t next(size_t i) {
+        return i + 1 == SIZE ? 0 : i + 1;
+    }
+
+    size_t last() const {
+        return (head + count - 1) % SIZE;
+    }
+
+    std::array<T, SIZE> values;
+    std::array<size_t, SIZE> seqs;
+    size_t head;
+    size_t count;
+};
+
+// Variance of a sliding window. Integral samples keep an exact sum of squares
+// in 64 bits, floating point ones use the sliding form of Welford's update.
+template <class T, size_t SIZE, bool INTEGRAL = std::is_integral<T>::value>
+class WindowVariance {
+public:
+    WindowVariance() : sum(0), sq_sum(0) {}
+
+    void push(const T& t, const T& old) {
+        sum += int64_t(t) - int64_t(old);
+        sq_sum += int64_t(t) * t - int64_t(old) * old;
+    }
+
+    T get() const {
+        return T((int64_t(SIZE) * sq_sum - sum * sum) / (int64_t(SIZE) * SIZE));
+    }
+
+    void clear(T t) {
+        sum = int64_t(t) * SIZE;
+        sq_sum = int64_t(t) * t * SIZE;
+    }
+
+private:
+    int64_t sum;
+    int64_t sq_sum;
+};
+
+template <class T, size_t SIZE>
+class WindowVariance<T, SIZE, false> {
+public:
+    WindowVariance() : mean(0), m2(0) {}
+
+    void push(const T& t, const T& old) {
+        T old_mean = mean;
+        mean += (t - old) / T(SIZE);
+        m2 += (t - old) * (t - mean + old - old_mean);
+    }
+
+    T get() const {
+        // rounding may drive the sum of squares slightly below zero
+        return m2 > T(0) ? m2 / T(SIZE) : T(0);
+    }
+
+    void clear(T t) {
+        mean = t;
+        m2 = 0;
+    }
+
+private:
+    T mean;
+    T m2;
+};
+
+} // namespace detail
+
+// Average of the last SIZE samples; the window starts filled with zeros.
+// The window is stored inline, so the class does not allocate. For integral
+// types and power-of-two sizes the average is computed by a shift, which rounds
+// towards minus infinity instead of towards zero.
 template <class T, size_t SIZE>
 class RollingAverage {
 public:
-    RollingAverage() : values( SIZE, T( 0 ) ), sum(0), index(0)
-    {
-        // std::fill(values.begin(), values.end(), T(0));
+    RollingAverage() : sum(0), index(0) {
+        values.fill(T(0));
     };
 
-    void push(const T& t) {
-        sum += t - values[index];
+    // Returns the sample which left the window
+    T push(const T& t) {
+        T old = values[index];
+        sum += t - old;
         values[index] = t;
         index++;
         if (index == SIZE)
             index = 0;
+        return old;
     }
 
-    T get_average() {
-        return sum / T(SIZE);
+    T get_average() const {
+        return average(std::integral_constant<bool,
+            std::is_integral<T>::value && detail::is_power_of_two(SIZE)>());
     }
 
-    T get_sum() {
+    T get_sum() const {
         return sum;
     }
 
     void clear(T t = 0) {
-        std::fill(values.begin(), values.end(), t);
+        values.fill(t);
         sum = t * SIZE;
     }
 
 private:
-    std::vector< T > values;
+    T average(std::true_type) const {
+        return sum >> detail::log2(SIZE);
+    }
+
+    T average(std::false_type) const {
+        return sum / T(SIZE);
+    }
+
+    std::array<T, SIZE> values;
     T sum;
     size_t index;
 };
 
+// Rolling average which also tracks the minimum, the maximum and the variance
+// (population variance) of the window. All of them are updated in O(1) amortized
+// time per sample, min and max by monotonic queues.
+template <class T, size_t SIZE>
+class RollingStatistics : public RollingAverage<T, SIZE> {
+    using Base = RollingAverage<T, SIZE>;
+public:
+    RollingStatistics() : seq(SIZE - 1) {
+        min.reset(T(0), seq);
+        max.reset(T(0), seq);
+    }
+
+    T push(const T& t) {
+        T old = Base::push(t);
+        seq++;
+        min.push(t, seq);
+        max.push(t, seq);
+        variance.push(t, old);
+        return old;
+    }
+
+    T get_min() const {
+        return min.front();
+    }
+
+    T get_max() const {
+        return max.front();
+    }
+
+    T get_variance() const {
+        return variance.get();
+    }
+
+    void clear(T t = 0) {
+        Base::clear(t);
+        min.reset(t, seq);
+        max.reset(t, seq);
+        variance.clear(t);
+    }
+
+private:
+    size_t seq;
+    detail::MonotonicQueue<T, SIZE, std::less<T>> min;
+    detail::MonotonicQueue<T, SIZE, std::greater<T>> max;
+    detail::WindowVariance<T, SIZE> variance;
+};
+
 }
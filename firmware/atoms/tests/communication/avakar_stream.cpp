@@ -0,0 +1,110 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/communication/avakar_stream.h>
+#include <atoms/communication/schema.h>
+#include <vector>
+
+using namespace atoms;
+
+namespace {
+
+struct Decoded {
+    uint8_t command;
+    std::vector<uint8_t> data;
+
+    bool operator==(const Decoded& o) const {
+        return command == o.command && data == o.data;
+    }
+};
+
+std::vector<Decoded> decode_chunks(AvakarStream& s, const std::vector<uint8_t>& stream,
+    size_t chunk)
+{
+    std::vector<Decoded> out;
+    auto f = [&](const AvakarView& v) {
+        out.push_back({ v.command(), { v.data(), v.data() + v.size() } });
+    };
+    for (size_t i = 0; i < stream.size(); i += chunk)
+        s.decode(stream.data() + i, std::min(chunk, stream.size() - i), f);
+    s.finish(f);
+    return out;
+}
+
+using Motors = Schema<AvakarFrame<1>, int16_t, int16_t, int16_t>;
+
+void append_motors(std::vector<uint8_t>& v, int16_t l, int16_t r, int16_t e) {
+    uint8_t frame[Motors::size];
+    Motors::encode(frame, l, r, e);
+    v.insert(v.end(), frame, frame + sizeof(frame));
+}
+
+}
+
+TEST_CASE("Avakar stream splits packets", "communication/avakar_stream.h:clean") {
+    std::vector<uint8_t> stream = { 0x80, 0x02, 0x11, 0x22, 0x80, 0x30, 0x80, 0x51, 0x80 };
+    AvakarStream s;
+    auto p = decode_chunks(s, stream, stream.size());
+    REQUIRE( p.size() == 3 );
+    REQUIRE( p[0] == Decoded{ 0, { 0x11, 0x22 } } );
+    REQUIRE( p[1] == Decoded{ 3, {} } );
+    REQUIRE( p[2] == Decoded{ 5, { 0x80 } } );
+    REQUIRE( s.packets() == 3 );
+    REQUIRE( s.skipped() == 0 );
+    REQUIRE( s.resyncs() == 0 );
+}
+
+TEST_CASE("Avakar stream gives the same result for any chunking", "communication/avakar_stream.h:chunks") {
+    std::vector<uint8_t> stream = { 0x12, 0x34 };
+    for (int i = 0; i != 50; i++)
+        append_motors(stream, i, -128, 0x80);
+
+    AvakarStream whole;
+    auto expected = decode_chunks(whole, stream, stream.size());
+    REQUIRE( expected.size() == 50 );
+    REQUIRE( whole.skipped() == 2 );
+
+    for (size_t chunk : { 1, 2, 3, 7, 17, 18, 19, 64 }) {
+        AvakarStream s;
+        REQUIRE( decode_chunks(s, stream, chunk) == expected );
+        REQUIRE( s.skipped() == 2 );
+    }
+}
+
+TEST_CASE("Avakar stream resynchronises after corruption", "communication/avakar_stream.h:resync") {
+    std::vector<uint8_t> stream;
+    append_motors(stream, 1, 2, 3);
+    append_motors(stream, 4, 5, 6);
+    append_motors(stream, 7, 8, 9);
+    // lose a byte of the second packet and put garbage before the third
+    stream.erase(stream.begin() + 12);
+    stream.insert(stream.begin() + 15, { 0x80, 0x0F, 0x00 });
+
+    AvakarStream s;
+    s.expect<Motors>();
+    std::vector<int16_t> firsts;
+    auto f = [&](const AvakarView& v) {
+        int16_t l, r, e;
+        REQUIRE( Motors::decode(v.raw, v.raw_size(), l, r, e) );
+        firsts.push_back(l);
+    };
+    for (size_t i = 0; i != stream.size(); i++)
+        s.decode(&stream[i], 1, f);
+    s.finish(f);
+
+    REQUIRE( firsts == std::vector<int16_t>({ 1, 7 }) );
+    REQUIRE( s.packets() == 2 );
+    REQUIRE( s.resyncs() > 0 );
+    REQUIRE( s.skipped() == stream.size() - 2 * Motors::size );
+}
+
+TEST_CASE("Avakar stream drops a truncated last packet", "communication/avakar_stream.h:finish") {
+    std::vector<uint8_t> stream = { 0x80, 0x10, 0x80, 0x13, 0x01 };
+    AvakarStream s;
+    auto p = decode_chunks(s, stream, 2);
+    REQUIRE( p.size() == 1 );
+    REQUIRE( p[0] == Decoded{ 1, {} } );
+    REQUIRE( s.skipped() == 3 );
+}
@@ -0,0 +1,102 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/communication/schema.h>
+#include <atoms/communication/avakar.h>
+#include <atoms/communication/packet.h>
+#include <vector>
+
+using namespace atoms;
+
+using Motors = Schema<AvakarFrame<1>, int16_t, int16_t, int16_t>;
+using Mixed  = Schema<AvakarFrame<3>, uint8_t, float, int8_t>;
+using Trace  = Schema<SizedFrame<7>, uint32_t, uint8_t>;
+
+static_assert(Motors::size == 8, "");
+static_assert(Mixed::offset<0>() == 2, "");
+static_assert(Mixed::offset<1>() == 3, "");
+static_assert(Mixed::offset<2>() == 7, "");
+static_assert(Trace::offset<1>() == 8, "");
+
+TEST_CASE("Schema encodes the same frame as Avakar packet", "communication/schema.h:avakar") {
+    AvakarPacket p;
+    p.set_command(1);
+    p.push<int16_t>(-300);
+    p.push<int16_t>(7);
+    p.push<int16_t>(0x1234);
+
+    uint8_t buffer[Motors::size];
+    REQUIRE( Motors::encode(buffer, -300, 7, 0x1234) == Motors::size );
+    REQUIRE( std::vector<uint8_t>(buffer, buffer + sizeof(buffer))
+        == std::vector<uint8_t>(p.raw(), p.raw() + p.raw_size()) );
+
+    uint8_t mixed[Mixed::size];
+    Mixed::encode(mixed, 200, 1.5f, -2);
+    REQUIRE( mixed[1] == 0x36 );
+    REQUIRE( Mixed::get<0>(mixed) == 200 );
+    REQUIRE( Mixed::get<1>(mixed) == 1.5f );
+    REQUIRE( Mixed::get<2>(mixed) == -2 );
+}
+
+TEST_CASE("Schema decoding", "communication/schema.h:decode") {
+    uint8_t buffer[Motors::size];
+    Motors::encode(buffer, 1, -2, 3);
+
+    int16_t a, b, c;
+    REQUIRE( Motors::decode(buffer, sizeof(buffer), a, b, c) );
+    REQUIRE( a == 1 );
+    REQUIRE( b == -2 );
+    REQUIRE( c == 3 );
+
+    Motors::Record r;
+    REQUIRE( Motors::decode(buffer, sizeof(buffer), r) );
+    REQUIRE( r == Motors::Record(1, -2, 3) );
+
+    // truncated frame, other command, other schema
+    REQUIRE_FALSE( Motors::decode(buffer, sizeof(buffer) - 1, r) );
+    buffer[1] = 0x26;
+    REQUIRE_FALSE( Motors::matches(buffer, sizeof(buffer)) );
+    uint8_t mixed[Mixed::size];
+    Mixed::encode(mixed, 1, 2, 3);
+    REQUIRE_FALSE( Motors::matches(mixed, sizeof(mixed)) );
+}
+
+TEST_CASE("Schema with scattered unbounded payload", "communication/schema.h:gather") {
+    const char first[] = { 'a', 'b', 'c' };
+    const char second[] = { 'd', 'e' };
+    Segment payload[] = { { first, sizeof(first) }, { second, sizeof(second) } };
+
+    uint8_t head[Trace::size];
+    auto g = Trace::encode(head, payload, 0xDEADBEEF, 9);
+    REQUIRE( g.count == 3 );
+    REQUIRE( g.size() == Trace::size + 5 );
+    REQUIRE( g.parts[0].data == head );
+    REQUIRE( g.parts[1].data == first );
+    REQUIRE( head[2] == 10 );
+    REQUIRE( head[3] == 0 );
+
+    std::vector<uint8_t> frame;
+    for (const Segment& s : g.parts) {
+        auto d = static_cast<const uint8_t*>(s.data);
+        frame.insert(frame.end(), d, d + s.size);
+    }
+    uint32_t stamp;
+    uint8_t tag;
+    REQUIRE( Trace::decode(frame.data(), frame.size(), stamp, tag) );
+    REQUIRE( stamp == 0xDEADBEEF );
+    REQUIRE( tag == 9 );
+    REQUIRE( Trace::payload_size(frame.data()) == 5 );
+    REQUIRE( std::string(reinterpret_cast<const char*>(Trace::payload(frame.data())), 5) == "abcde" );
+
+    // the same frame parsed by a generic packet
+    Packet<StaticU8<0x80>, CommandU8, SizeU16, BoundedData<32>> p;
+    size_t i = 0;
+    while (!p.push_byte(frame[i]))
+        i++;
+    REQUIRE( i + 1 == frame.size() );
+    REQUIRE( p.get_command() == 7 );
+    REQUIRE( p.get_data_size() == 10 );
+    REQUIRE( p.get<uint32_t>(0) == 0xDEADBEEF );
+}
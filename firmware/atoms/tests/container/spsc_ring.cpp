@@ -0,0 +1,85 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/container/spsc_ring.h>
+#include <thread>
+#include <string>
+
+using namespace atoms;
+
+TEST_CASE("Ring buffer keeps order and capacity", "container/spsc_ring.h:basic") {
+    SpscRing<int, 4> ring;
+    REQUIRE( ring.empty() );
+    REQUIRE( ring.peek() == nullptr );
+
+    for (int i = 0; i != 4; i++)
+        REQUIRE( ring.push(i) );
+    REQUIRE( ring.full() );
+    REQUIRE( !ring.push(42) );
+
+    int v;
+    REQUIRE( ring.pop(v) );
+    REQUIRE( v == 0 );
+    REQUIRE( *ring.peek() == 1 );
+    ring.skip(2);
+    REQUIRE( ring.size() == 1 );
+    REQUIRE( ring.push(4) );
+    REQUIRE( ring.pop(v) );
+    REQUIRE( v == 3 );
+    REQUIRE( ring.pop(v) );
+    REQUIRE( v == 4 );
+    REQUIRE( !ring.pop(v) );
+    ring.skip(5);
+    REQUIRE( ring.empty() );
+}
+
+TEST_CASE("Ring buffer bulk access", "container/spsc_ring.h:bulk") {
+    SpscRing<char, 8> ring;
+    REQUIRE( ring.push_n("abcde", 5) );
+    REQUIRE( !ring.push_n("fghi", 4) );
+    REQUIRE( ring.size() == 5 );
+
+    const char* block;
+    REQUIRE( ring.peek_block(block) == 5 );
+    REQUIRE( std::string(block, 5) == "abcde" );
+    ring.skip(4);
+
+    // wraps around the end of the storage
+    REQUIRE( ring.push_n("fghijkl", 7) );
+    REQUIRE( ring.full() );
+    REQUIRE( ring.peek_block(block) == 4 );
+    REQUIRE( std::string(block, 4) == "efgh" );
+    ring.skip(4);
+    REQUIRE( ring.peek_block(block) == 4 );
+    REQUIRE( std::string(block, 4) == "ijkl" );
+    ring.skip(4);
+    REQUIRE( ring.peek_block(block) == 0 );
+}
+
+TEST_CASE("Ring buffer transfers items between threads", "container/spsc_ring.h:threads") {
+    SpscRing<unsigned, 16> ring;
+    const unsigned count = 100000;
+
+    std::thread producer([&] {
+        for (unsigned i = 0; i != count; ) {
+            if (ring.push(i))
+                i++;
+        }
+    });
+
+    unsigned expected = 0;
+    bool ordered = true;
+    while (expected != count) {
+        unsigned v;
+        if (ring.pop(v)) {
+            ordered = ordered && v == expected;
+            expected++;
+        }
+    }
+    producer.join();
+
+    REQUIRE( ordered );
+    REQUIRE( ring.empty() );
+}
@@ -0,0 +1,44 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/control/pid.h>
+#include <atoms/numeric/fixed.h>
+
+using namespace atoms;
+
+TEST_CASE("Filtered PID proportional term", "control/pid.h:proportional") {
+    FilteredPid<float> pid({ 2, 0, 0, 1, -10, 10 });
+    REQUIRE( pid.step(1, 3) == Approx(4) );
+    REQUIRE( pid.step(0, 100) == Approx(10) );
+    REQUIRE( pid.step(0, -100) == Approx(-10) );
+}
+
+TEST_CASE("Filtered PID derivative is filtered and kick-free", "control/pid.h:derivative") {
+    FilteredPid<float> pid({ 0, 0, 1, 0.5f, -100, 100 });
+    REQUIRE( pid.step(0, 50) == Approx(0) );
+    // step in measurement: half of the rate passes the filter
+    REQUIRE( pid.step(4, 50) == Approx(-2) );
+    REQUIRE( pid.step(4, 50) == Approx(-1) );
+    // set-point change does not cause a kick
+    REQUIRE( pid.step(4, 0) == Approx(-0.5) );
+}
+
+TEST_CASE("Filtered PID integrator does not wind up", "control/pid.h:windup") {
+    FilteredPid<float> pid({ 1, 1, 0, 1, -5, 5 });
+    for (int i = 0; i != 100; i++)
+        REQUIRE( pid.step(0, 10) == Approx(5) );
+    // integrator is not saturated far beyond the limit, output leaves
+    // saturation as soon as the error changes sign
+    REQUIRE( pid.get_state().integrator <= 5 );
+    REQUIRE( pid.step(0, -1) < 5 );
+}
+
+TEST_CASE("Filtered PID works in fixed point", "control/pid.h:fixed") {
+    using F = Fixed<16, 16>;
+    FilteredPid<F> pid({ F(0.5f), F(0.25f), F(0), F(1), F(-40), F(40) });
+    REQUIRE( pid.step(F(0), F(8)).to_float() == Approx(6) );
+    REQUIRE( pid.step(F(0), F(8)).to_float() == Approx(8) );
+    REQUIRE( pid.step(F(0), F(-8)).to_float() == Approx(-2) );
+}
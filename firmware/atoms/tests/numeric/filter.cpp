@@ -0,0 +1,128 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/numeric/filter.h>
+
+using namespace atoms;
+
+TEST_CASE("Exponential filter converges to the input", "numeric/filter.h:exp") {
+    ExpFilter<int32_t, 2> f;
+    REQUIRE( f.get() == 0 );
+    REQUIRE( f.push(100) == 25 );
+    for (int i = 0; i != 100; i++)
+        f.push(100);
+    REQUIRE( f.get() == 100 );
+
+    f.reset(-40);
+    REQUIRE( f.get() == -40 );
+    for (int i = 0; i != 100; i++)
+        f.push(-40);
+    REQUIRE( f.get() == -40 );
+}
+
+TEST_CASE("Exponential filter does not lose small steps", "numeric/filter.h:precision") {
+    ExpFilter<int32_t, 4> f(10);
+    // a naive y += (x - y) >> 4 would never move for a step smaller than 16
+    for (int i = 0; i != 200; i++)
+        f.push(13);
+    REQUIRE( f.get() == 13 );
+}
+
+TEST_CASE("Cascaded exponential filter", "numeric/filter.h:exp2") {
+    ExpFilter2<int32_t, 1> f;
+    REQUIRE( f.push(64) == 16 );
+    REQUIRE( f.push(64) == 32 );
+    for (int i = 0; i != 100; i++)
+        f.push(64);
+    REQUIRE( f.get() == 64 );
+}
+
+TEST_CASE("Median filter removes outliers", "numeric/filter.h:median") {
+    MedianFilter<int, 5> m(50);
+    REQUIRE( m.push(255) == 50 );
+    REQUIRE( m.push(49) == 50 );
+    REQUIRE( m.push(0) == 50 );
+    REQUIRE( m.push(48) == 49 );
+    REQUIRE( m.push(47) == 48 );
+    REQUIRE( m.push(46) == 47 );
+    m.reset(10);
+    REQUIRE( m.get() == 10 );
+}
+
+TEST_CASE("Debounce ignores glitches", "numeric/filter.h:debounce") {
+    Debounce<3> d;
+    REQUIRE_FALSE( d.push(true) );
+    REQUIRE_FALSE( d.push(false) );
+    REQUIRE_FALSE( d.push(true) );
+    REQUIRE_FALSE( d.push(true) );
+    REQUIRE( d.push(true) );
+    REQUIRE( d.push(false) );
+    REQUIRE( d.push(true) );
+    REQUIRE( d.push(false) );
+    REQUIRE( d.push(false) );
+    REQUIRE_FALSE( d.push(false) );
+
+    d.reset(true);
+    REQUIRE( d.get() );
+}
+
+TEST_CASE("Bit window counts the recent true samples", "numeric/filter.h:bitwindow") {
+    BitWindow<5> w;
+    REQUIRE( w.count() == 0 );
+    REQUIRE( w.push(true) == 1 );
+    REQUIRE( w.push(false) == 1 );
+    REQUIRE( w.push(true) == 2 );
+    REQUIRE( w.push(true) == 3 );
+    REQUIRE( w.push(false) == 3 );
+    // the first sample leaves the window
+    REQUIRE( w.push(false) == 2 );
+    REQUIRE( w.push(false) == 2 );
+    REQUIRE( w.push(false) == 1 );
+    REQUIRE( w.push(false) == 0 );
+
+    BitWindow<64> full;
+    for (int i = 0; i != 64; i++)
+        full.push(true);
+    REQUIRE( full.count() == 64 );
+    REQUIRE( full.push(false) == 63 );
+    full.reset();
+    REQUIRE( full.count() == 0 );
+}
+
+TEST_CASE("Rate estimator ignores values jumping into range", "numeric/filter.h:rate") {
+    // sonar distance medians every 30 ms, in range up to 80 cm
+    RateEstimator<2> r(300);
+    uint32_t t = 0;
+    auto ping = [&](int cm) {
+        t += 30000;
+        return r.push(cm, t, cm <= 80);
+    };
+    ping(255);
+    ping(255);
+    // an object appears at 60 cm and holds still
+    REQUIRE( ping(60) == 0 );
+    for (int i = 0; i != 10; i++)
+        REQUIRE( ping(60) == 0 );
+
+    // approaches at 100 cm/s
+    for (int cm = 57; cm > 30; cm -= 3)
+        ping(cm);
+    REQUIRE( r.get() < -90 );
+    REQUIRE( r.get() >= -100 );
+
+    // leaves the range, the estimate starts over
+    REQUIRE( ping(255) == 0 );
+    REQUIRE( ping(40) == 0 );
+}
+
+TEST_CASE("Rate estimator drops implausible rates", "numeric/filter.h:rate_limit") {
+    RateEstimator<1> r(300);
+    r.push(60, 0);
+    // 30 cm in 30 ms is 1000 cm/s
+    REQUIRE( r.push(30, 30000) == 0 );
+    // the estimate continues from the new value
+    REQUIRE( r.push(27, 60000) == -50 );
+    REQUIRE( r.push(24, 90000) == -75 );
+}
@@ -0,0 +1,72 @@
+#include <catch.hpp>
+
+// This file is part of 'Atoms' library - https://github.com/yaqwsx/atoms
+// Author: Jan 'yaqwsx' Mrázek
+
+#include <atoms/numeric/rolling_average.h>
+#include <vector>
+#include <algorithm>
+
+using namespace atoms;
+
+TEST_CASE("Rolling average", "numeric/rolling_average.h:average") {
+    RollingAverage<int, 4> a;
+    REQUIRE( a.get_average() == 0 );
+    REQUIRE( a.push(4) == 0 );
+    REQUIRE( a.get_average() == 1 );
+    a.push(4);
+    a.push(4);
+    a.push(4);
+    REQUIRE( a.get_average() == 4 );
+    REQUIRE( a.push(8) == 4 );
+    REQUIRE( a.get_average() == 5 );
+    REQUIRE( a.get_sum() == 20 );
+
+    a.clear(-3);
+    REQUIRE( a.get_average() == -3 );
+
+    RollingAverage<float, 3> f;
+    f.push(1);
+    f.push(2);
+    f.push(3);
+    f.push(4);
+    REQUIRE( f.get_average() == Approx(3) );
+}
+
+TEST_CASE("Rolling statistics match a naive window", "numeric/rolling_average.h:statistics") {
+    RollingStatistics<int, 5> s;
+    RollingStatistics<double, 5> d;
+    std::vector<int> window(5, 0);
+    int x = 7;
+    for (int i = 0; i != 200; i++) {
+        x = (x * 37 + 11) % 101 - 50;
+        s.push(x);
+        d.push(x);
+        window.erase(window.begin());
+        window.push_back(x);
+
+        int sum = 0;
+        int sq = 0;
+        for (int v : window) {
+            sum += v;
+            sq += v * v;
+        }
+        double mean = sum / 5.0;
+        double var = sq / 5.0 - mean * mean;
+
+        REQUIRE( s.get_min() == *std::min_element(window.begin(), window.end()) );
+        REQUIRE( s.get_max() == *std::max_element(window.begin(), window.end()) );
+        REQUIRE( s.get_variance() == (5 * sq - sum * sum) / 25 );
+        REQUIRE( d.get_min() == *std::min_element(window.begin(), window.end()) );
+        REQUIRE( d.get_max() == *std::max_element(window.begin(), window.end()) );
+        REQUIRE( d.get_variance() == Approx(var).margin(1e-6) );
+    }
+
+    s.clear(3);
+    REQUIRE( s.get_min() == 3 );
+    REQUIRE( s.get_max() == 3 );
+    REQUIRE( s.get_variance() == 0 );
+    s.push(-1);
+    REQUIRE( s.get_min() == -1 );
+    REQUIRE( s.get_max() == 3 );
+}
@@ -6,31 +6,37 @@
 
 namespace {
 
-int distance( DestMap& map, Position via, Position to ) {
-    int dx = via.x - to.x;
-    int dy = via.y - to.y;
-    assert( std::abs( dx ) + std::abs( dy ) == 1 );
+// Costs of the planner actions, a forward step is 2 so that a backward one can be
+// priced in between a straight step and a step with a turn
+const int STRAIGHT_COST = 2;
+const int TURN_COST = 2;    // per quarter turn
+const int REVERSE_COST = 3; // backward line following, no turn
+
+int turnCost( Pred heading, Pred travel ) {
+    if ( heading == Pred::None || heading == travel )
+        return 0;
+    if ( heading == invert( travel ) )
+        return 2 * TURN_COST;
+    return TURN_COST;
+}
 
-    auto& viaD = map[ via ];
+// Cost of reaching to from via, the neighbouring cell in direction dir; reverse is
+// set if driving backwards is cheaper
+int distance( DestMap& map, Position via, Position to, Pred dir, bool& reverse ) {
+    assert( std::abs( via.x - to.x ) + std::abs( via.y - to.y ) == 1 );
 
+    auto& viaD = map[ via ];
+    reverse = false;
     if ( viaD.distance == inf )
         return inf;
 
-    Pred dir;
-    if ( dx == -1 && dy == 0 )
-        dir = Pred::West;
-    else if ( dx == 1 && dy == 0 )
-        dir = Pred::East;
-    else if ( dx == 0 && dy == 1 )
-        dir = Pred::North;
-    else if ( dx == 0 && dy == -1 )
-        dir = Pred::South;
-    else
-        assert( false );
-
-    if ( dir == map[ to ].pred )
-        return viaD.distance + 1;
-    return viaD.distance + 2;
+    Pred travel = invert( dir );
+    int cost = viaD.distance + STRAIGHT_COST + turnCost( viaD.heading, travel );
+    if ( viaD.heading != Pred::None && viaD.heading == dir && viaD.distance + REVERSE_COST < cost ) {
+        reverse = true;
+        cost = viaD.distance + REVERSE_COST;
+    }
+    return cost;
 }
 
 void relax( DestMap& map, Position p, const std::set< Position >& forbid ) {
@@ -51,10 +57,13 @@ void relax( DestMap& map, Position p, const std::set< Position >& forbid ) {
         if ( n.x < 0 || n.x >= s.w ||
              n.y < 0 || n.y >= s.h )
             continue;
-        int d = distance( map, n, p );
+        bool reverse;
+        int d = distance( map, n, p, neighbour.second, reverse );
         if ( destination.distance > d ) {
             destination.distance = d;
             destination.pred = neighbour.second;
+            destination.reverse = reverse;
+            destination.heading = reverse ? map[ n ].heading : invert( neighbour.second );
         }
     }
 }
@@ -71,8 +80,9 @@ DestMap shortestPaths( RobotPosition from, Size size, std::set< Position > forbi
         from.y = size.h;
     }
 
-    DestMap map{ size, Destination{ Pred::None, inf } };
+    DestMap map{ size, Destination{ Pred::None, inf, false, Pred::None } };
     map[ from ].distance = 0;
+    map[ from ].heading = from.orient;
 
     for( int i = 0; i != 2 * ( size.w + size.h ); i++ )
         for ( int x = 0; x != size.w; x++ )
@@ -44,6 +44,13 @@ struct Size {
 struct Destination {
     Pred pred;
     int distance;
+    bool reverse;  // the cell is entered driving backwards
+    Pred heading;  // where the robot faces after entering the cell
+};
+
+struct Move {
+    Pred dir;      // direction of travel
+    bool reverse;  // driven backwards, the robot keeps facing invert( dir )
 };
 
 template < typename T >
@@ -90,6 +97,19 @@ struct DestMap: public Map2D< Destination > {
     return path;
 }
 
+    std::vector< Move > movesTo( Position pos ) {
+        std::vector< Move > moves;
+        while ( true ) {
+            const auto& x = (*this)[ pos ];
+            if ( x.distance == 0 )
+                break;
+            moves.push_back( { invert( x.pred ), x.reverse } );
+            pos = getPred( pos );
+        }
+        std::reverse( moves.begin(), moves.end() );
+        return moves;
+    }
+
     Position getPred( Position p ) {
         switch( ( *this )[ p ].pred ) {
             case Pred::North:
@@ -7,16 +7,28 @@
 
 extern Logger l;
 
+
+inline Angle headingOf( Pred p )
+{
+	return static_cast< Angle >( static_cast< int >( p ) ) * QUARTER_TURN;
+}
+
+
 struct KetchupLogic
 {
-	KetchupLogic( Robot& r )
+	KetchupLogic( Robot& r, int gridMm = 280 )
 			: position( 3, 0, Pred::North ),
 //			: position( 1, 0, Pred::North ),
 			  opponentValidFor( 0 ),
 			  ketchupCount( 0 ),
 			  lastUnloadPosition( 1 ),
 //			  lastUnloadPosition( 3 ),
-              robot( r ) { }
+              gridMm( gridMm ),
+              robot( r )
+	{
+		robot.odometry.reset( position.x * gridMm, position.y * gridMm, headingOf( position.orient ) );
+		recordPose( 3 );
+	}
 
 
 	void go( const Position& p )
@@ -36,13 +48,39 @@ struct KetchupLogic
 			l.logInfo( "", "Going: {}, {}", position.x, position.y );
 			auto pathMap = shortestPaths( position, { 7, 7 }, f );
 //			auto pathMap = shortestPaths( position, { 3, 3 }, f );
-			auto dir = pathMap.pathTo( p ).front();
-			face( dir );
-			auto status = step();
+			auto moves = pathMap.movesTo( p );
+			auto dir = moves.front().dir;
+			robot.recorder.record( FlightEventType::Plan, static_cast< uint8_t >( dir ), position.x, position.y,
+			                       p.x, p.y, moves.front().reverse );
+			if ( onCrossing ) {
+				bool turn = !moves.front().reverse && std::abs( turnBetween( position.orient, dir ) ) == 1;
+				if ( ( turn ? arc( dir ) : settle() ) == Robot::State::RivalDetected ) {
+					// The sensors are already past the crossing of the current cell
+					onOpponent( robot.settleMm + 40 );
+					continue;
+				}
+			}
+			Robot::State status;
+			if ( moves.front().reverse ) {
+				status = stepBack();
+			} else {
+				face( dir );
+				// Do not stop on the intersection if the robot turns there anyway
+				bool turnNext = moves.size() > 1 && !moves[ 1 ].reverse &&
+				                std::abs( turnBetween( dir, moves[ 1 ].dir ) ) == 1;
+				status = step( !turnNext );
+			}
 			l.logInfo( "", "Step done {}, {}", position.x, position.y );
 			switch ( status ) {
 				case Robot::State::RivalDetected:
-					onOpponent();
+					if ( !moves.front().reverse && robot.stepLineState != Robot::State::RivalDetected ) {
+						// Seen in the settle, the sensors are past the crossing already
+						onOpponent( robot.settleMm + 40 );
+						if ( robot.stepLineState == Robot::State::KetchupDetected )
+							onKetchup();
+					} else {
+						onOpponent();
+					}
 					break;
 				case Robot::State::KetchupDetected:
 					onKetchup();
@@ -58,9 +96,36 @@ struct KetchupLogic
 	}
 
 
-	Robot::State step( )
+	Robot::State step( bool settle = true )
 	{
-		switch ( position.orient ) {
+		advance( position.orient );
+		auto status = robot.step( 1, Robot::Debug::Default, false, ketchupCount, settle );
+		if ( status != Robot::State::RivalDetected ) {
+			// The robot stands on the intersection (or settleMm before it) and is
+			// aligned with the line
+			onCrossing = !settle;
+			correctOdometry( settle ? 0 : -robot.settleMm );
+		}
+		return status;
+	}
+
+
+	// Drives one cell backwards, the robot keeps its orientation
+	Robot::State stepBack( int lockoutMm = -1 )
+	{
+		advance( invert( position.orient ) );
+		if ( lockoutMm < 0 )
+			lockoutMm = robot.settleMm + 40;
+		auto status = robot.stepBackward( lockoutMm );
+		if ( status != Robot::State::RivalDetected )
+			correctOdometry( 0 );
+		return status;
+	}
+
+
+	void advance( Pred dir )
+	{
+		switch ( dir ) {
 			case Pred::North:
 				position.y++;
 				break;
@@ -79,7 +144,53 @@ struct KetchupLogic
 				assert( false );
 				break;
 		}
-		return robot.step( 1, Robot::Debug::Default, false, ketchupCount);
+	}
+
+
+	// Finishes a step which stopped with the sensors on the crossing
+	Robot::State settle( )
+	{
+		onCrossing = false;
+		auto status = robot._moveForward( robot.settleMm );
+		if ( status != Robot::State::RivalDetected )
+			correctOdometry( 0 );
+		return status;
+	}
+
+
+	// Turns onto the next line from the crossing; a rival ahead stops the robot
+	// before the turn, in the original orientation
+	Robot::State arc( const Pred p )
+	{
+		onCrossing = false;
+		int rot = turnBetween( position.orient, p );
+		l.logInfo( "", "Arc: [ {} ]" ) << rot;
+		auto status = robot.arcTurn( rot * 90 );
+		if ( status == Robot::State::RivalDetected )
+			return status;
+		position.orient = p;
+		correctOdometry( robot.arcRadiusMm );
+		return status;
+	}
+
+
+	// The robot is aheadMm past the current intersection in the direction of travel
+	void correctOdometry( int aheadMm )
+	{
+		int dx = position.orient == Pred::East ? 1 : position.orient == Pred::West ? -1 : 0;
+		int dy = position.orient == Pred::North ? 1 : position.orient == Pred::South ? -1 : 0;
+		robot.odometry.correctPosition( position.x * gridMm + dx * aheadMm, position.y * gridMm + dy * aheadMm );
+		robot.odometry.correctHeading( headingOf( position.orient ) );
+		recordPose( 3 );
+	}
+
+
+	// So that the replay in tools/ can apply the same corrections
+	void recordPose( uint8_t corrected )
+	{
+		const Odometry& o = robot.odometry;
+		robot.recorder.record( FlightEventType::Pose, 0, o.xMm(), o.yMm(),
+		                       static_cast< int16_t >( o.heading() >> 16 ), corrected );
 	}
 
 
@@ -115,11 +226,11 @@ struct KetchupLogic
 		face( Pred::East );
 
 		robot._moveForward(15);
-		robot.motors.off();
+		// The gate opens and closes while the robot keeps moving
 		robot.openGate();
 		go( { lastUnloadPosition + 2, 0 } );
 
-		robot.motors.off();
+		robot.motorsOff();
 		robot.closeGate();
 		robot.findLine();
 //		ev3cxx::delayMs( 1500 );
@@ -140,7 +251,6 @@ struct KetchupLogic
 
 		l.logInfo( "", "Back: [ {} ; {} ]" ) << x << y;
 
-		ev3cxx::delayMs( 1500 );
 //		go( origin );
 		go( { x, y } );
 
@@ -157,12 +267,13 @@ struct KetchupLogic
 	}
 
 
-	void onOpponent( )
+	void onOpponent( int lockoutMm = 40 )
 	{
 		opponent = position;
 		opponentValidFor = 4;
-		face( invert( position.orient ) );
-		step();
+		// The robot stopped between the intersections, so the first crossing behind
+		// it is the one it came from
+		stepBack( lockoutMm );
 	}
 
 
@@ -172,20 +283,31 @@ struct KetchupLogic
 			return;
 		}
 
-		int rot = static_cast< int >( p ) - static_cast< int >( position.orient );
+		int rot = turnBetween( position.orient, p );
+		l.logInfo( "", "Rotation: [ {} ]" ) << rot;
+		robot.rotate( rot * 90 );
+		position.orient = p;
+		robot.odometry.correctHeading( headingOf( p ) );
+		recordPose( 2 );
+	}
+
+
+	// Quarter turns from one direction to another, counter-clockwise positive
+	static int turnBetween( Pred from, Pred to )
+	{
+		int rot = static_cast< int >( to ) - static_cast< int >( from );
 		if ( rot > 2 ) {
 			rot -= 4;
 		} else if ( rot < -2 ) {
 			rot += 4;
 		}
-
-		l.logInfo( "", "Rotation: [ {} ]" ) << rot;
-		robot.rotate( rot * 90 );
-		position.orient = p;
+		return rot;
 	}
 
 
 	RobotPosition position;
+	// The last step stopped with the sensors on the crossing, see Robot::step()
+	bool onCrossing = false;
 
 	Position opponent;
 	int opponentValidFor;
@@ -197,5 +319,6 @@ struct KetchupLogic
 
 	std::set < Position > occupied;
 //	std::vector < Position > occupied;
+	int gridMm;
 	Robot& robot;
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+// Reader of Lorris analyzer sessions (.cldta). The file starts with a 64 byte
+// header beginning with "LDTA", the session follows as written by Qt's
+// qCompress(): the big-endian size of the data and a zlib stream.
+//
+// The session is a sequence of blocks, each introduced by 0x80, a NUL-terminated
+// name and 0x80; integers are little endian. Two of them matter here:
+//     dataFilter - u8, u32 id, u32 length and the name of a channel; the
+//                  cmdCondition block which follows gives the Avakar command
+//                  the channel shows
+//     dataBlock  - u32 count, then every received packet as u32 size and bytes
+// The others (packet layout, widgets, view) are skipped.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+
+struct LorrisSession
+{
+	struct Packet
+	{
+		uint32_t offset;   // into data
+		uint32_t size;
+	};
+
+	std::vector < uint8_t > data;       // decompressed session
+	std::vector < Packet > packets;
+	std::string channelName[ 16 ];      // by Avakar command, empty without a filter
+	bool truncated = false;
+};
+
+
+namespace lorris_detail
+{
+	const size_t HEADER_SIZE = 64;
+
+
+	inline uint32_t le32( const uint8_t* p )
+	{
+		return p[ 0 ] | p[ 1 ] << 8 | p[ 2 ] << 16 | uint32_t( p[ 3 ] ) << 24;
+	}
+
+
+	// Position of the content of the block, or 0 if there is none in [from, to)
+	inline size_t findBlock( const std::vector < uint8_t >& data, const char* name, size_t from, size_t to )
+	{
+		std::string marker = std::string( 1, '\x80' ) + name + std::string( 1, '\0' ) + '\x80';
+		if ( to > data.size() || from >= to )
+			return 0;
+		const uint8_t* begin = data.data();
+		const void* hit = memmem( begin + from, to - from, marker.data(), marker.size() );
+		return hit ? static_cast< const uint8_t* >( hit ) - begin + marker.size() : 0;
+	}
+}
+
+
+inline bool readLorrisSession( const std::string& path, LorrisSession& session, std::string& error )
+{
+	using namespace lorris_detail;
+
+	FILE* f = std::fopen( path.c_str(), "rb" );
+	if ( !f ) {
+		error = std::strerror( errno );
+		return false;
+	}
+	std::vector < uint8_t > file;
+	uint8_t buffer[ 65536 ];
+	size_t n;
+	while ( ( n = std::fread( buffer, 1, sizeof( buffer ), f ) ) != 0 )
+		file.insert( file.end(), buffer, buffer + n );
+	std::fclose( f );
+
+	if ( file.size() < HEADER_SIZE + 4 || std::memcmp( file.data(), "LDTA", 4 ) != 0 ) {
+		error = "not a Lorris session";
+		return false;
+	}
+	const uint8_t* z = file.data() + HEADER_SIZE;
+	uLongf size = uLongf( z[ 0 ] ) << 24 | z[ 1 ] << 16 | z[ 2 ] << 8 | z[ 3 ];
+	session.data.resize( size );
+	int r = uncompress( session.data.data(), &size, z + 4, file.size() - HEADER_SIZE - 4 );
+	if ( r != Z_OK || size != session.data.size() ) {
+		error = std::string( "cannot decompress: " ) + zError( r );
+		return false;
+	}
+
+	const std::vector < uint8_t >& d = session.data;
+	size_t block = findBlock( d, "dataBlock", 0, d.size() );
+	if ( block == 0 || block + 4 > d.size() ) {
+		error = "no data block";
+		return false;
+	}
+
+	// Channel names, the filters precede the data
+	size_t pos = 0;
+	while ( ( pos = findBlock( d, "dataFilter", pos, block ) ) != 0 ) {
+		if ( pos + 9 > block )
+			break;
+		uint32_t length = le32( &d[ pos + 5 ] );
+		size_t name = pos + 9;
+		if ( name + length > block )
+			break;
+		size_t next = findBlock( d, "dataFilter", name, block );
+		size_t cmd = findBlock( d, "cmdCondition", name + length, next ? next : block );
+		if ( cmd != 0 && cmd < d.size() && d[ cmd ] < 16 )
+			session.channelName[ d[ cmd ] ].assign( reinterpret_cast< const char* >( &d[ name ] ), length );
+		pos = name + length;
+	}
+
+	uint32_t count = le32( &d[ block ] );
+	pos = block + 4;
+	session.packets.reserve( count );
+	for ( uint32_t i = 0; i != count; i++ ) {
+		if ( pos + 4 > d.size() || pos + 4 + le32( &d[ pos ] ) > d.size() ) {
+			session.truncated = true;
+			break;
+		}
+		uint32_t s = le32( &d[ pos ] );
+		session.packets.push_back( { uint32_t( pos + 4 ), s } );
+		pos += 4 + s;
+	}
+	return true;
+}
@@ -0,0 +1,352 @@
+/**
+ * Exports the packets of Lorris analyzer sessions (.cldta) per channel, decoded
+ * with the telemetry records of TelemetrySchema.h. A channel is an Avakar command;
+ * it is named by the session's data filter, or by the record, or cmd<N>. Commands
+ * without a record are exported as raw bytes b0..bN.
+ *
+ *     cldta [--columns] [-o outdir] [-j N] session.cldta...
+ *
+ * CSV goes to <outdir>/<session>.<channel>.csv. With --columns every column is a
+ * raw little-endian array in <outdir>/<session>/<channel>.<column>.<type>, e.g.
+ * motors_line.left.i16, to be loaded with numpy.fromfile() and the like. Lorris
+ * does not store when a packet came, rows carry its position in the session (seq)
+ * instead, which is common to all channels of the session.
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <atoms/communication/avakar_stream.h>
+
+#include "TelemetrySchema.h"
+#include "LorrisSession.h"
+
+
+enum class Field : uint8_t { U8, I8, U16, I16, U32, I32, F32 };
+
+template < typename T > struct FieldOf;
+template < > struct FieldOf < uint8_t > { static const Field value = Field::U8; };
+template < > struct FieldOf < int8_t > { static const Field value = Field::I8; };
+template < > struct FieldOf < uint16_t > { static const Field value = Field::U16; };
+template < > struct FieldOf < int16_t > { static const Field value = Field::I16; };
+template < > struct FieldOf < uint32_t > { static const Field value = Field::U32; };
+template < > struct FieldOf < int32_t > { static const Field value = Field::I32; };
+template < > struct FieldOf < float > { static const Field value = Field::F32; };
+
+
+static const char* fieldName( Field f )
+{
+	static const char* names[] = { "u8", "i8", "u16", "i16", "u32", "i32", "f32" };
+	return names[ int( f ) ];
+}
+
+
+static size_t fieldSize( Field f )
+{
+	static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+	return sizes[ int( f ) ];
+}
+
+
+struct Column
+{
+	std::string name;
+	Field field;
+	size_t offset;   // in the data of the packet
+};
+
+
+struct Channel
+{
+	std::string name;
+	size_t dataSize = 0;
+	std::vector < Column > columns;
+};
+
+
+template < typename Schema, size_t... I >
+static Channel channelOf( const char* name, const std::vector < const char* >& columns, std::index_sequence < I... > )
+{
+	static_assert( Schema::frame::header_size == 2, "Lorris sessions carry Avakar packets" );
+	Channel c;
+	c.name = name;
+	c.dataSize = Schema::data_size;
+	c.columns = { Column{ columns[ I ], FieldOf < typename Schema::template type < I > >::value,
+	                      Schema::template offset < I >() - Schema::frame::header_size }... };
+	return c;
+}
+
+
+template < typename Schema >
+static std::pair < uint8_t, Channel > channelOf( const char* name, const std::vector < const char* >& columns )
+{
+	return { Schema::frame::command, channelOf < Schema >( name, columns, std::make_index_sequence < Schema::field_count >() ) };
+}
+
+
+// The records sent by Debug::Packet
+static const std::vector < std::pair < uint8_t, Channel > >& records( )
+{
+	static const std::vector < std::pair < uint8_t, Channel > > r = {
+		channelOf < tlm::ColorSensors >( "color_sensor", { "left", "right", "sum", "errorNeg" } ),
+		channelOf < tlm::MotorsLine >( "motors_line", { "left", "right", "errorNeg" } ),
+		channelOf < tlm::Parameter >( "parameter", { "id", "value" } ),
+	};
+	return r;
+}
+
+
+struct ChannelData
+{
+	Channel channel;
+	bool known = false;
+	bool raw = false;
+	std::vector < uint32_t > seq;
+	std::vector < uint8_t > data;   // dataSize bytes per row
+};
+
+
+struct Options
+{
+	bool columns = false;
+	std::string outdir = ".";
+};
+
+
+static std::string baseName( const std::string& path )
+{
+	size_t slash = path.find_last_of( '/' );
+	std::string name = slash == std::string::npos ? path : path.substr( slash + 1 );
+	size_t dot = name.rfind( '.' );
+	return dot == std::string::npos || dot == 0 ? name : name.substr( 0, dot );
+}
+
+
+template < typename T >
+static T load( const uint8_t* p )
+{
+	T t;
+	std::memcpy( &t, p, sizeof( T ) );
+	return t;
+}
+
+
+static void appendValue( std::string& out, Field f, const uint8_t* p )
+{
+	char buf[ 32 ];
+	int n;
+	switch ( f ) {
+		case Field::U8: n = std::snprintf( buf, sizeof( buf ), "%u", load < uint8_t >( p ) ); break;
+		case Field::I8: n = std::snprintf( buf, sizeof( buf ), "%d", load < int8_t >( p ) ); break;
+		case Field::U16: n = std::snprintf( buf, sizeof( buf ), "%u", load < uint16_t >( p ) ); break;
+		case Field::I16: n = std::snprintf( buf, sizeof( buf ), "%d", load < int16_t >( p ) ); break;
+		case Field::U32: n = std::snprintf( buf, sizeof( buf ), "%u", load < uint32_t >( p ) ); break;
+		case Field::I32: n = std::snprintf( buf, sizeof( buf ), "%d", load < int32_t >( p ) ); break;
+		default: n = std::snprintf( buf, sizeof( buf ), "%g", load < float >( p ) ); break;
+	}
+	out.append( buf, n );
+}
+
+
+static bool writeFile( const std::string& path, const void* data, size_t size, std::string& error )
+{
+	FILE* f = std::fopen( path.c_str(), "wb" );
+	if ( !f || std::fwrite( data, 1, size, f ) != size ) {
+		error = path + ": " + std::strerror( errno );
+		if ( f )
+			std::fclose( f );
+		return false;
+	}
+	if ( std::fclose( f ) != 0 ) {
+		error = path + ": " + std::strerror( errno );
+		return false;
+	}
+	return true;
+}
+
+
+static bool writeCsv( const std::string& path, const ChannelData& c, std::string& error )
+{
+	std::string out = "seq";
+	for ( const Column& col : c.channel.columns )
+		out += "," + col.name;
+	out += "\n";
+	out.reserve( out.size() + c.seq.size() * ( 8 + 5 * c.channel.columns.size() ) );
+	for ( size_t row = 0; row != c.seq.size(); row++ ) {
+		char buf[ 16 ];
+		out.append( buf, std::snprintf( buf, sizeof( buf ), "%u", c.seq[ row ] ) );
+		const uint8_t* d = c.data.data() + row * c.channel.dataSize;
+		for ( const Column& col : c.channel.columns ) {
+			out += ',';
+			appendValue( out, col.field, d + col.offset );
+		}
+		out += '\n';
+	}
+	return writeFile( path, out.data(), out.size(), error );
+}
+
+
+static bool writeColumns( const std::string& dir, const ChannelData& c, std::string& error )
+{
+	const std::string prefix = dir + "/" + c.channel.name + ".";
+	if ( !writeFile( prefix + "seq.u32", c.seq.data(), c.seq.size() * sizeof( uint32_t ), error ) )
+		return false;
+	std::vector < uint8_t > column;
+	for ( const Column& col : c.channel.columns ) {
+		size_t size = fieldSize( col.field );
+		column.resize( c.seq.size() * size );
+		for ( size_t row = 0; row != c.seq.size(); row++ )
+			std::memcpy( &column[ row * size ], &c.data[ row * c.channel.dataSize + col.offset ], size );
+		if ( !writeFile( prefix + col.name + "." + fieldName( col.field ), column.data(), column.size(), error ) )
+			return false;
+	}
+	return true;
+}
+
+
+// Returns the summary of the session, or false and the error
+static bool exportSession( const std::string& path, const Options& options, std::string& summary, std::string& error )
+{
+	LorrisSession session;
+	if ( !readLorrisSession( path, session, error ) )
+		return false;
+
+	ChannelData channels[ 16 ];
+	atoms::AvakarStream stream;
+	for ( const auto& r : records() ) {
+		channels[ r.first ].channel = r.second;
+		channels[ r.first ].known = true;
+		stream.expect( r.first, r.second.dataSize );
+	}
+	for ( int cmd = 0; cmd != 16; cmd++ )
+		if ( !session.channelName[ cmd ].empty() )
+			channels[ cmd ].channel.name = session.channelName[ cmd ];
+
+	uint64_t mismatched = 0;
+	uint32_t seq = 0;
+	auto onPacket = [ & ]( const atoms::AvakarView& v ) {
+		ChannelData& c = channels[ v.command() ];
+		if ( !c.known ) {
+			// the first packet gives the layout of a command without a record
+			c.known = true;
+			c.raw = true;
+			c.channel.dataSize = v.size();
+			for ( size_t i = 0; i != v.size(); i++ )
+				c.channel.columns.push_back( { "b" + std::to_string( i ), Field::U8, i } );
+		}
+		if ( v.size() != c.channel.dataSize ) {
+			mismatched++;
+			return;
+		}
+		c.seq.push_back( seq );
+		c.data.insert( c.data.end(), v.data(), v.data() + v.size() );
+	};
+	// Lorris stores packets whole, each is decoded on its own
+	for ( const LorrisSession::Packet& p : session.packets ) {
+		stream.decode( &session.data[ p.offset ], p.size, onPacket );
+		stream.finish( onPacket );
+		seq++;
+	}
+
+	const std::string base = baseName( path );
+	std::string dir = options.outdir;
+	if ( options.columns ) {
+		dir += "/" + base;
+		if ( mkdir( dir.c_str(), 0777 ) != 0 && errno != EEXIST ) {
+			error = dir + ": " + std::strerror( errno );
+			return false;
+		}
+	}
+
+	char line[ 160 ];
+	std::snprintf( line, sizeof( line ), "%s: %zu packets%s, %zu skipped bytes, %zu rejected, %llu size mismatches\n",
+	               path.c_str(), session.packets.size(), session.truncated ? " (truncated)" : "",
+	               stream.skipped(), stream.resyncs(), static_cast< unsigned long long >( mismatched ) );
+	summary = line;
+	for ( int cmd = 0; cmd != 16; cmd++ ) {
+		ChannelData& c = channels[ cmd ];
+		if ( c.seq.empty() )
+			continue;
+		if ( c.channel.name.empty() )
+			c.channel.name = "cmd" + std::to_string( cmd );
+		bool ok = options.columns ? writeColumns( dir, c, error )
+		                          : writeCsv( dir + "/" + base + "." + c.channel.name + ".csv", c, error );
+		if ( !ok )
+			return false;
+		std::snprintf( line, sizeof( line ), "    %2d %-24s %8zu rows%s\n", cmd, c.channel.name.c_str(), c.seq.size(),
+		               c.raw ? " (raw)" : "" );
+		summary += line;
+	}
+	return true;
+}
+
+
+static int usage( )
+{
+	std::fprintf( stderr, "usage: cldta [--columns] [-o outdir] [-j N] session.cldta...\n" );
+	return 1;
+}
+
+
+int main( int argc, char** argv )
+{
+	Options options;
+	unsigned jobs = std::thread::hardware_concurrency();
+	std::vector < std::string > paths;
+	for ( int i = 1; i < argc; i++ ) {
+		std::string arg = argv[ i ];
+		if ( arg == "--columns" )
+			options.columns = true;
+		else if ( arg == "-o" && i + 1 < argc )
+			options.outdir = argv[ ++i ];
+		else if ( arg == "-j" && i + 1 < argc )
+			jobs = std::strtoul( argv[ ++i ], nullptr, 10 );
+		else if ( !arg.empty() && arg[ 0 ] == '-' )
+			return usage();
+		else
+			paths.push_back( arg );
+	}
+	if ( paths.empty() )
+		return usage();
+	if ( jobs == 0 )
+		jobs = 1;
+	if ( jobs > paths.size() )
+		jobs = paths.size();
+
+	// Sessions are independent, the workers take them one by one
+	std::vector < std::string > summaries( paths.size() );
+	std::vector < std::string > errors( paths.size() );
+	std::vector < char > ok( paths.size() );
+	std::atomic < size_t > next( 0 );
+	auto worker = [ & ] {
+		size_t i;
+		while ( ( i = next++ ) < paths.size() )
+			ok[ i ] = exportSession( paths[ i ], options, summaries[ i ], errors[ i ] );
+	};
+	std::vector < std::thread > workers;
+	for ( unsigned i = 1; i < jobs; i++ )
+		workers.emplace_back( worker );
+	worker();
+	for ( std::thread& t : workers )
+		t.join();
+
+	int failed = 0;
+	for ( size_t i = 0; i != paths.size(); i++ ) {
+		if ( ok[ i ] )
+			std::fputs( summaries[ i ].c_str(), stdout );
+		else {
+			std::fprintf( stderr, "%s: %s\n", paths[ i ].c_str(), errors[ i ].c_str() );
+			failed++;
+		}
+	}
+	return failed ? 1 : 0;
+}
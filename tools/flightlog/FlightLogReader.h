@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "FlightLog.h"
+
+
+struct FlightLogFile
+{
+	FlightLogHeader header;
+	std::vector < FlightEvent > events;
+	bool truncated = false;
+};
+
+
+// Reads a dump written by FlightRecorder::dump(); a truncated file keeps the
+// complete events
+inline bool readFlightLog( const char* path, FlightLogFile& log, std::string& error )
+{
+	FILE* file = std::fopen( path, "rb" );
+	if ( !file ) {
+		error = std::strerror( errno );
+		return false;
+	}
+	FlightLogHeader& h = log.header;
+	if ( std::fread( &h, sizeof( h ), 1, file ) != 1 || std::memcmp( h.magic, "KFLT", 4 ) != 0 ) {
+		std::fclose( file );
+		error = "not a flight recorder dump";
+		return false;
+	}
+	if ( h.version != FLIGHT_LOG_VERSION || h.eventSize != sizeof( FlightEvent ) ) {
+		std::fclose( file );
+		error = "unsupported version " + std::to_string( h.version );
+		return false;
+	}
+	log.events.resize( h.count );
+	size_t read = std::fread( log.events.data(), sizeof( FlightEvent ), h.count, file );
+	std::fclose( file );
+	log.truncated = read != h.count;
+	log.events.resize( read );
+	return true;
+}
+
+
+// The recorder keeps only the low 16 bits of the encoders; consecutive samples
+// are milliseconds apart, so the difference always fits. The result is offset by
+// an unknown multiple of 65536 degrees, only the differences are meaningful.
+struct EncoderUnwrap
+{
+	int32_t operator()( int16_t low )
+	{
+		if ( first ) {
+			value = low;
+			first = false;
+		}
+		else
+			value += static_cast< int16_t >( low - static_cast< int16_t >( value ) );
+		return value;
+	}
+
+	int32_t value = 0;
+	bool first = true;
+};
+
+
+// Event times are 32 bit microseconds which wrap after ~71 minutes; converts them
+// to a monotonic 64 bit time line. Events may be slightly out of order (a sonar
+// ping is recorded when it is consumed, with the time it was taken).
+struct TimeUnwrap
+{
+	uint64_t operator()( uint32_t t )
+	{
+		if ( first ) {
+			value = t;
+			first = false;
+		}
+		else
+			value += static_cast< int32_t >( t - static_cast< uint32_t >( value ) );
+		return value;
+	}
+
+	uint64_t value = 0;
+	bool first = true;
+};
@@ -0,0 +1,155 @@
+/**
+ * Decodes the flight recorder dump written by Robot::exit() (flight.bin on the SD
+ * card) to a readable listing or to CSV.
+ *
+ *     flightlog [--csv] flight.bin
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#include "FlightLogReader.h"
+
+
+static const char* primitiveName( int p )
+{
+	static const char* names[] = { "?", "step", "stepBackward", "moveForward", "moveBackward",
+	                               "rotate", "arcTurn", "findLine", "calibrate" };
+	return p >= 0 && p < int( sizeof( names ) / sizeof( *names ) ) ? names[ p ] : "?";
+}
+
+
+static const char* stateName( int s )
+{
+	static const char* names[] = { "PositionReached", "KetchupDetected", "RivalDetected" };
+	return s >= 0 && s < 3 ? names[ s ] : "?";
+}
+
+
+static const char* typeName( int t )
+{
+	static const char* names[] = { "?", "sensor", "motors", "primitive", "plan", "detector", "exit", "sonar",
+	                               "pose", "parameter" };
+	return t >= 0 && t < int( sizeof( names ) / sizeof( *names ) ) ? names[ t ] : "?";
+}
+
+
+static void print( const FlightEvent& e, uint32_t t0, EncoderUnwrap& encL, EncoderUnwrap& encR, bool csv )
+{
+	double t = static_cast< int32_t >( e.timeUs - t0 ) / 1000.0;
+	const int16_t* v = e.v;
+	switch ( static_cast< FlightEventType >( e.type ) ) {
+		case FlightEventType::Sensor: {
+			int32_t l = encL( v[ 2 ] );
+			int32_t r = encR( v[ 3 ] );
+			if ( csv )
+				std::printf( "%.3f,sensor,%d,%d,%d,%d,%d\n", t, e.arg, v[ 0 ], v[ 1 ], l, r );
+			else
+				std::printf( "%10.3f  sensor     L %3d  R %3d  touch %d  enc %d %d\n", t, v[ 0 ], v[ 1 ], e.arg, l, r );
+			break;
+		}
+		case FlightEventType::Motors: {
+			static const char* action[] = { "on", "off", "brake" };
+			if ( csv )
+				std::printf( "%.3f,motors,%d,%d,%d\n", t, e.arg, v[ 0 ], v[ 1 ] );
+			else if ( e.arg == 0 )
+				std::printf( "%10.3f  motors     %d %d\n", t, v[ 0 ], v[ 1 ] );
+			else
+				std::printf( "%10.3f  motors     %s\n", t, action[ e.arg < 3 ? e.arg : 1 ] );
+			break;
+		}
+		case FlightEventType::Primitive:
+			if ( csv )
+				std::printf( "%.3f,primitive,%d,%d\n", t, e.arg, v[ 0 ] );
+			else if ( v[ 0 ] < 0 )
+				std::printf( "%10.3f  primitive  %s( %d, %d )\n", t, primitiveName( e.arg ), v[ 1 ], v[ 2 ] );
+			else
+				std::printf( "%10.3f  primitive  %s -> %s\n", t, primitiveName( e.arg ), stateName( v[ 0 ] ) );
+			break;
+		case FlightEventType::Plan: {
+			static const char* dirs[] = { "North", "West", "South", "East" };
+			if ( csv )
+				std::printf( "%.3f,plan,%d,%d,%d,%d,%d,%d\n", t, e.arg, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], v[ 4 ] );
+			else
+				std::printf( "%10.3f  plan       [%d, %d] -> [%d, %d] %s%s\n", t, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ],
+				             v[ 4 ] ? "back " : "", e.arg < 4 ? dirs[ e.arg ] : "?" );
+			break;
+		}
+		case FlightEventType::Detector: {
+			static const char* states[] = { "Clear", "Enemy", "Unsure", "NoData" };
+			if ( csv )
+				std::printf( "%.3f,detector,%d,%d,%d\n", t, e.arg, v[ 0 ], v[ 1 ] );
+			else
+				std::printf( "%10.3f  detector   %s  %d cm  %d cm/s\n", t, e.arg < 4 ? states[ e.arg ] : "?",
+				             v[ 0 ], v[ 1 ] );
+			break;
+		}
+		case FlightEventType::Sonar:
+			if ( csv )
+				std::printf( "%.3f,sonar,%d,%d\n", t, e.arg, v[ 0 ] );
+			else
+				std::printf( "%10.3f  sonar      %d: %d cm\n", t, e.arg, v[ 0 ] );
+			break;
+		case FlightEventType::Pose:
+			if ( csv )
+				std::printf( "%.3f,pose,%d,%d,%d,%d,%d\n", t, e.arg, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] );
+			else
+				std::printf( "%10.3f  pose       %d %d mm  %.1f deg%s\n", t, v[ 0 ], v[ 1 ],
+				             uint16_t( v[ 2 ] ) * 360.0 / 65536, v[ 3 ] == 2 ? " (heading)" : "" );
+			break;
+		case FlightEventType::Parameter: {
+			int32_t value = int32_t( uint16_t( v[ 0 ] ) | uint32_t( v[ 1 ] ) << 16 );
+			if ( csv )
+				std::printf( "%.3f,parameter,%d,%d\n", t, e.arg, value );
+			else
+				std::printf( "%10.3f  parameter  %d = %d\n", t, e.arg, value );
+			break;
+		}
+		case FlightEventType::Exit:
+			if ( csv )
+				std::printf( "%.3f,exit,%d\n", t, e.arg );
+			else
+				std::printf( "%10.3f  exit       %d\n", t, e.arg );
+			break;
+		default:
+			if ( csv )
+				std::printf( "%.3f,%s,%d\n", t, typeName( e.type ), e.arg );
+			else
+				std::printf( "%10.3f  unknown    %d\n", t, e.type );
+			break;
+	}
+}
+
+
+int main( int argc, char** argv )
+{
+	bool csv = argc == 3 && std::string( argv[ 1 ] ) == "--csv";
+	if ( argc != 2 && !csv ) {
+		std::fprintf( stderr, "Usage: %s [--csv] flight.bin\n", argv[ 0 ] );
+		return 1;
+	}
+	const char* path = argv[ argc - 1 ];
+	FlightLogFile log;
+	std::string error;
+	if ( !readFlightLog( path, log, error ) ) {
+		std::fprintf( stderr, "%s: %s\n", path, error.c_str() );
+		return 1;
+	}
+	if ( log.truncated )
+		std::fprintf( stderr, "%s: truncated, %zu of %u events\n", path, log.events.size(), log.header.count );
+	const std::vector < FlightEvent >& events = log.events;
+
+	if ( csv )
+		std::printf( "time_ms,type,arg,v0,v1,v2,v3,v4\n" );
+	else
+		std::printf( "%u events recorded, the last %zu kept\n", log.header.recorded, events.size() );
+	if ( events.empty() )
+		return 0;
+
+	EncoderUnwrap encL, encR;
+	uint32_t t0 = events.front().timeUs;
+	for ( const FlightEvent& e : events )
+		print( e, t0, encL, encR, csv );
+	return 0;
+}
@@ -0,0 +1,429 @@
+/**
+ * Replays a flight recorder dump through the firmware control code built for the
+ * host (see tools/shim). Every top-level motion primitive of the recording is
+ * called again with the same arguments, fed with the recorded sensor frames and
+ * sonar pings at their recorded times, and the motor commands it produces are
+ * compared with the recorded ones. The time is virtual, so the replay runs as
+ * fast as the control code allows.
+ *
+ * With --link the replay runs in real time and the robot's Bluetooth traffic,
+ * Debug::Packet telemetry included, goes through a pseudo-terminal with the
+ * bandwidth and latency of the real link (see shim/BluetoothLink.h). The
+ * telemetry and command tasks run as threads like on the robot, so Lorris or a
+ * tuning script can be developed against recorded runs.
+ *
+ *     replay [--config config.json] [--verbose]
+ *            [--link [--bandwidth bytes/s] [--latency ms]] flight.bin
+ *
+ * The exit code is 1 if any primitive behaved differently than on the robot.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ev3cxx.h"
+#include "BluetoothLink.h"
+#include "libs/logging/logging.hpp"
+#include "Robot.h"
+#include "RobotConfig.h"
+#include "CommandChannel.h"
+#include "flightlog/FlightLogReader.h"
+
+
+struct TimedFrame
+{
+	uint64_t t;
+	SensorFrame frame;
+};
+
+
+struct TimedPing
+{
+	uint64_t t;
+	int cm;
+};
+
+
+struct MotorCommand
+{
+	bool operator==( const MotorCommand& o ) const
+	{
+		return action == o.action && a == o.a && b == o.b;
+	}
+
+	uint64_t t;
+	int action;
+	int a, b;
+};
+
+
+// A primitive called from outside of the Robot, with everything it has consumed
+// and produced
+struct PrimitiveRun
+{
+	FlightPrimitive type;
+	int16_t a0, a1;
+	uint64_t begin;
+	uint64_t end;
+	int result;                         // -1 if the recording ends before it
+	std::vector < FlightEvent > prelude; // odometry corrections and tuned parameters just before it
+	std::vector < MotorCommand > motors;
+};
+
+
+struct Recording
+{
+	std::vector < TimedFrame > frames;
+	std::vector < TimedPing > pings;
+	std::vector < PrimitiveRun > runs;
+	uint64_t start = 0;
+	uint64_t last = 0;
+};
+
+
+static Recording parse( const std::vector < FlightEvent >& events )
+{
+	Recording r;
+	TimeUnwrap time;
+	EncoderUnwrap encL, encR;
+	std::vector < FlightEvent > prelude;
+	int depth = 0;
+	for ( const FlightEvent& e : events ) {
+		uint64_t t = time( e.timeUs );
+		if ( r.start == 0 )
+			r.start = t;
+		r.last = std::max( r.last, t );
+		const int16_t* v = e.v;
+		switch ( static_cast< FlightEventType >( e.type ) ) {
+			case FlightEventType::Sensor:
+				r.frames.push_back( { t, { e.timeUs, v[ 0 ], v[ 1 ], encL( v[ 2 ] ), encR( v[ 3 ] ), e.arg != 0 } } );
+				break;
+			case FlightEventType::Sonar:
+				if ( e.arg == 0 )
+					r.pings.push_back( { t, v[ 0 ] } );
+				break;
+			case FlightEventType::Pose:
+			case FlightEventType::Parameter:
+				if ( depth == 0 )
+					prelude.push_back( e );
+				break;
+			case FlightEventType::Motors:
+				if ( depth > 0 )
+					r.runs.back().motors.push_back( { t, e.arg, v[ 0 ], v[ 1 ] } );
+				break;
+			case FlightEventType::Primitive:
+				if ( v[ 0 ] < 0 ) {
+					if ( depth++ == 0 ) {
+						r.runs.push_back( { static_cast< FlightPrimitive >( e.arg ), v[ 1 ], v[ 2 ], t, 0, -1,
+						                    std::move( prelude ), { } } );
+						prelude.clear();
+					}
+				}
+				// An end at depth 0 belongs to a primitive which started before the recording
+				else if ( depth > 0 && --depth == 0 ) {
+					r.runs.back().end = t;
+					r.runs.back().result = v[ 0 ];
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	std::stable_sort( r.pings.begin(), r.pings.end(), []( const TimedPing& a, const TimedPing& b ) {
+		return a.t < b.t;
+	} );
+	return r;
+}
+
+
+struct Overrun { };
+
+
+// Delivers the recorded data as the virtual time passes, the way sensor_task and
+// sonar_task would
+struct Feed
+{
+	void until( uint64_t to )
+	{
+		const uint64_t never = std::numeric_limits < uint64_t >::max();
+		while ( true ) {
+			uint64_t tf = nextFrame < rec.frames.size() ? rec.frames[ nextFrame ].t : never;
+			uint64_t tp = nextPing < rec.pings.size() ? rec.pings[ nextPing ].t : never;
+			uint64_t t = std::min( tf, tp );
+			if ( t > to )
+				break;
+			shim::setTimeUs( t );
+			if ( tf <= tp ) {
+				const SensorFrame& f = rec.frames[ nextFrame++ ].frame;
+				// MotorTank{ D, A }, see main_task
+				shim::hardware.encoder[ int( ev3cxx::MotorPort::D ) ] = f.encoderL;
+				shim::hardware.encoder[ int( ev3cxx::MotorPort::A ) ] = f.encoderR;
+				shim::hardware.touch[ int( ev3cxx::SensorPort::S2 ) ] = f.touch;
+				sampler.publish( f );
+			}
+			else {
+				shim::hardware.distanceCm[ int( ev3cxx::SensorPort::S1 ) ] = rec.pings[ nextPing++ ].cm;
+				sonar.sample();
+			}
+		}
+		if ( to > deadline )
+			throw Overrun();
+	}
+
+	const Recording& rec;
+	SensorSampler& sampler;
+	SonarService& sonar;
+	size_t nextFrame;
+	size_t nextPing;
+	uint64_t deadline;
+};
+
+
+static const char* primitiveName( FlightPrimitive p )
+{
+	static const char* names[] = { "?", "step", "stepBackward", "moveForward", "moveBackward",
+	                               "rotate", "arcTurn", "findLine", "calibrate" };
+	int i = static_cast< int >( p );
+	return i > 0 && i < int( sizeof( names ) / sizeof( *names ) ) ? names[ i ] : "?";
+}
+
+
+static const char* stateName( int s )
+{
+	static const char* names[] = { "PositionReached", "KetchupDetected", "RivalDetected" };
+	return s >= 0 && s < 3 ? names[ s ] : s == -1 ? "unfinished" : s == -2 ? "overrun" : "?";
+}
+
+
+static Robot::State call( Robot& robot, const PrimitiveRun& run, Robot::Debug debug )
+{
+	switch ( run.type ) {
+		case FlightPrimitive::Step:
+			return robot._step( debug, run.a0 != 0, run.a1 );
+		case FlightPrimitive::StepBackward:
+			return robot.stepBackward( run.a0 );
+		case FlightPrimitive::MoveForward:
+			return robot._moveForward( run.a0 );
+		case FlightPrimitive::MoveBackward:
+			return robot._moveBackward( run.a0 );
+		case FlightPrimitive::Rotate:
+			return robot.rotate( run.a0, debug );
+		case FlightPrimitive::ArcTurn:
+			return robot.arcTurn( run.a0 );
+		case FlightPrimitive::FindLine:
+			robot.findLine();
+			return Robot::State::PositionReached;
+		default:
+			return Robot::State::PositionReached;
+	}
+}
+
+
+static FlightRecorder recorder;
+
+
+int main( int argc, char** argv )
+{
+	const char* configPath = nullptr;
+	const char* path = nullptr;
+	bool verbose = false;
+	bool link = false;
+	shim::BluetoothLink::Config linkConfig;
+	for ( int i = 1; i < argc; i++ ) {
+		std::string arg( argv[ i ] );
+		if ( arg == "--config" && i + 1 < argc )
+			configPath = argv[ ++i ];
+		else if ( arg == "--verbose" )
+			verbose = true;
+		else if ( arg == "--link" )
+			link = true;
+		else if ( arg == "--bandwidth" && i + 1 < argc )
+			linkConfig.bytesPerSecond = std::atoi( argv[ ++i ] );
+		else if ( arg == "--latency" && i + 1 < argc )
+			linkConfig.latencyUs = std::atoi( argv[ ++i ] ) * 1000;
+		else if ( !path && arg[ 0 ] != '-' )
+			path = argv[ i ];
+		else
+			path = nullptr, i = argc;
+	}
+	if ( !path ) {
+		std::fprintf( stderr, "Usage: %s [--config config.json] [--verbose] "
+		              "[--link [--bandwidth bytes/s] [--latency ms]] flight.bin\n", argv[ 0 ] );
+		return 2;
+	}
+
+	FlightLogFile log;
+	std::string error;
+	if ( !readFlightLog( path, log, error ) ) {
+		std::fprintf( stderr, "%s: %s\n", path, error.c_str() );
+		return 2;
+	}
+	Recording rec = parse( log.events );
+	if ( rec.runs.empty() ) {
+		std::fprintf( stderr, "%s: no complete primitive recorded\n", path );
+		return 2;
+	}
+
+	// The same devices and geometry as main_task
+	RobotGeometry robotGeometry{ 55, 130 };
+	ev3cxx::ColorSensor colorL{ ev3cxx::SensorPort::S3 };
+	ev3cxx::ColorSensor colorR{ ev3cxx::SensorPort::S4 };
+	ev3cxx::TouchSensor ketchupSensor{ ev3cxx::SensorPort::S2 };
+	ev3cxx::UltrasonicSensor sonar{ ev3cxx::SensorPort::S1 };
+	ev3cxx::BrickButton btnEnter( ev3cxx::BrickButtons::ENTER );
+	ev3cxx::BrickButton btnStop( ev3cxx::BrickButtons::UP );
+	ev3cxx::MotorTank motors{ ev3cxx::MotorPort::D, ev3cxx::MotorPort::A };
+	ev3cxx::Motor motorGate{ ev3cxx::MotorPort::C, ev3cxx::MotorType::MEDIUM };
+	ev3cxx::Motor motorSensor{ ev3cxx::MotorPort::B, ev3cxx::MotorType::MEDIUM };
+	ev3cxx::Bluetooth bt{ true };
+	Logger l;
+
+	shim::setTimeUs( rec.start );
+	SensorSampler sampler{ colorL, colorR, ketchupSensor, motors };
+	SonarService sonarService{ sonar, 3 * 30 };
+	Robot robot( robotGeometry, colorL, colorR, ketchupSensor, btnEnter, btnStop, motors, motorGate,
+	             l, bt, sonarService, motorSensor, sampler, recorder, Robot::Debug::No );
+	if ( configPath )
+		load_line_follower( load_config( configPath ), robot );
+	robot.calibrationFile = nullptr;
+	robot.recorderFile = nullptr;
+
+	// The Bluetooth link and the tasks using it, as in main_task
+	shim::BluetoothLink btLink( linkConfig );
+	Telemetry telemetry;
+	CommandChannel commands{ robot.parameters };
+	std::atomic < bool > tasksRunning{ link };
+	std::thread telemetryTask, commandTask;
+	if ( link ) {
+		std::string linkError;
+		if ( !btLink.open( linkError ) ) {
+			std::fprintf( stderr, "Bluetooth link: %s\n", linkError.c_str() );
+			return 2;
+		}
+		std::printf( "Bluetooth link on %s\n", btLink.path().c_str() );
+		std::fflush( stdout );
+		shim::hardware.openBluetooth = [ & ] { return btLink.openFile(); };
+		shim::hardware.onBluetooth = [ & ]( char c ) { btLink.write( reinterpret_cast< uint8_t* >( &c ), 1 ); };
+		shim::hardware.bluetoothConnected = true;
+		telemetry.open();
+		robot.telemetry = &telemetry;
+		commands.open();
+		telemetryTask = std::thread( [ & ] {
+			while ( tasksRunning ) {
+				telemetry.flush();
+				// PERIOD_TELEMETRY_TASK
+				std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+			}
+		} );
+		commandTask = std::thread( [ & ] {
+			while ( tasksRunning ) {
+				if ( !commands.receive() )
+					std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+			}
+		} );
+		shim::setRealTime( true );
+	}
+	const Robot::Debug debug = link ? Robot::Debug::Packet : Robot::Debug::No;
+
+	Feed feed{ rec, sampler, sonarService, 0, 0, 0 };
+	std::vector < MotorCommand > produced;
+	shim::hardware.onSleep = [ & ]( uint64_t to ) { feed.until( to ); };
+	shim::hardware.onTank = [ & ]( int action, int a, int b ) {
+		produced.push_back( { shim::timeUs(), action, a, b } );
+	};
+
+	int replayed = 0, differ = 0;
+	auto wallStart = std::chrono::steady_clock::now();
+	for ( const PrimitiveRun& run : rec.runs ) {
+		if ( run.type == FlightPrimitive::Calibrate )
+			continue;
+		feed.deadline = ( run.result >= 0 ? run.end : rec.last ) + 1000000;
+		feed.until( run.begin );
+		shim::setTimeUs( run.begin );
+		for ( const FlightEvent& p : run.prelude ) {
+			if ( p.type == uint8_t( FlightEventType::Parameter ) ) {
+				robot.parameters.set( p.arg, int32_t( uint16_t( p.v[ 0 ] ) | uint32_t( p.v[ 1 ] ) << 16 ) );
+				continue;
+			}
+			if ( p.v[ 3 ] & 1 )
+				robot.odometry.correctPosition( p.v[ 0 ], p.v[ 1 ] );
+			if ( p.v[ 3 ] & 2 )
+				robot.odometry.correctHeading( Angle( uint16_t( p.v[ 2 ] ) ) << 16 );
+		}
+
+		produced.clear();
+		int result;
+		try {
+			result = static_cast< int >( call( robot, run, debug ) );
+		}
+		catch ( const Overrun& ) {
+			result = -2;
+			robot.motorsOff();
+		}
+
+		size_t common = std::min( produced.size(), run.motors.size() );
+		size_t firstDiff = common;
+		int maxDiff = 0;
+		for ( size_t i = 0; i != common; i++ ) {
+			const MotorCommand& p = produced[ i ];
+			const MotorCommand& r = run.motors[ i ];
+			if ( !( p == r ) && firstDiff == common )
+				firstDiff = i;
+			if ( p.action == 0 && r.action == 0 )
+				maxDiff = std::max( { maxDiff, std::abs( p.a - r.a ), std::abs( p.b - r.b ) } );
+		}
+		bool same = ( result == run.result || run.result == -1 ) && firstDiff == common &&
+		            ( produced.size() == run.motors.size() || run.result == -1 );
+		replayed++;
+		differ += !same;
+
+		std::printf( "%9.3f  %-12s %5d %4d  %-15s %-4s motors %zu/%zu", ( run.begin - rec.start ) / 1e6,
+		             primitiveName( run.type ), run.a0, run.a1, stateName( result ), same ? "ok" : "DIFF",
+		             produced.size(), run.motors.size() );
+		if ( firstDiff != common )
+			std::printf( ", first difference at %.3f s, max %d", ( run.motors[ firstDiff ].t - rec.start ) / 1e6,
+			             maxDiff );
+		if ( result != run.result )
+			std::printf( ", recorded %s", stateName( run.result ) );
+		std::printf( "\n" );
+		if ( verbose && !same ) {
+			for ( size_t i = firstDiff; i < std::min( common, firstDiff + 10 ); i++ )
+				std::printf( "           %d %4d %4d   recorded %d %4d %4d\n", produced[ i ].action, produced[ i ].a,
+				             produced[ i ].b, run.motors[ i ].action, run.motors[ i ].a, run.motors[ i ].b );
+		}
+	}
+
+	double wall = std::chrono::duration < double >( std::chrono::steady_clock::now() - wallStart ).count();
+	double recorded = ( rec.last - rec.start ) / 1e6;
+	std::printf( "%d primitives replayed, %d differ; %.1f s of recording in %.3f s (%.0fx)\n", replayed, differ,
+	             recorded, wall, wall > 0 ? recorded / wall : 0.0 );
+	if ( link ) {
+		robot.safePoint();
+		tasksRunning = false;
+		telemetryTask.join();
+		telemetry.flush();
+		btLink.close();
+		commandTask.join();
+		shim::BluetoothLink::Stats st = btLink.stats();
+		// including the time the link needed to drain
+		double linkWall = std::chrono::duration < double >( std::chrono::steady_clock::now() - wallStart ).count();
+		std::printf( "link: %llu bytes sent (%.0f B/s), %llu received, writers blocked %.2f s\n",
+		             (unsigned long long) st.sentBytes, linkWall > 0 ? st.sentBytes / linkWall : 0.0,
+		             (unsigned long long) st.receivedBytes, st.blockedUs / 1e6 );
+		std::printf( "link: Avakar packets" );
+		for ( int c = 0; c != 16; c++ )
+			if ( st.sentPackets[ c ] )
+				std::printf( " %d:%llu", c, (unsigned long long) st.sentPackets[ c ] );
+		std::printf( ", %llu bytes outside of packets\n", (unsigned long long) st.skippedBytes );
+		std::printf( "telemetry: %u frames, %u dropped; commands: %u, %u rejected\n", telemetry.frameCount(),
+		             telemetry.dropCount(), commands.commandCount(), commands.rejectedCount() );
+	}
+	return differ ? 1 : 0;
+}
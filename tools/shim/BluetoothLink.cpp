@@ -0,0 +1,216 @@
+#include "BluetoothLink.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+namespace shim
+{
+	BluetoothLink::BluetoothLink( const Config& config )
+			: _config( config ), _master( -1 ), _slave( -1 ), _running( false ), _readers( 0 ), _queuedBytes( 0 )
+	{
+		if ( _config.bytesPerSecond == 0 )
+			_config.bytesPerSecond = 1;
+		if ( _config.txBuffer == 0 )
+			_config.txBuffer = 1;
+	}
+
+
+	BluetoothLink::~BluetoothLink( )
+	{
+		close();
+	}
+
+
+	bool BluetoothLink::open( std::string& error )
+	{
+		_master = posix_openpt( O_RDWR | O_NOCTTY );
+		char name[ 64 ];
+		if ( _master < 0 || grantpt( _master ) != 0 || unlockpt( _master ) != 0 ||
+		     ptsname_r( _master, name, sizeof( name ) ) != 0 ) {
+			error = std::strerror( errno );
+			return false;
+		}
+		_path = name;
+
+		// Keep the slave side open, so the link survives the PC side reconnecting,
+		// and raw, so nothing is echoed back to the robot
+		_slave = ::open( name, O_RDWR | O_NOCTTY );
+		termios t;
+		if ( _slave < 0 || tcgetattr( _slave, &t ) != 0 ) {
+			error = std::strerror( errno );
+			return false;
+		}
+		cfmakeraw( &t );
+		tcsetattr( _slave, TCSANOW, &t );
+		fcntl( _master, F_SETFL, fcntl( _master, F_GETFL ) | O_NONBLOCK );
+
+		_txDone = Clock::now();
+		_running = true;
+		_delivery = std::thread( [ this ] { deliver(); } );
+		return true;
+	}
+
+
+	void BluetoothLink::close( )
+	{
+		if ( _running.exchange( false ) ) {
+			_wake.notify_all();
+			_delivery.join();
+			std::lock_guard < std::mutex > lock( _mutex );
+			_stream.finish( [ this ]( const atoms::AvakarView& v ) {
+				_stats.sentPackets[ v.command() ]++;
+			} );
+			_stats.skippedBytes = _stream.skipped();
+		}
+		// readers notice within their poll timeout
+		while ( _readers != 0 )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		if ( _slave >= 0 )
+			::close( _slave );
+		if ( _master >= 0 )
+			::close( _master );
+		_slave = _master = -1;
+	}
+
+
+	static ssize_t readCookie( void* link, char* data, size_t size )
+	{
+		return static_cast< BluetoothLink* >( link )->read( reinterpret_cast< uint8_t* >( data ), size );
+	}
+
+
+	static ssize_t writeCookie( void* link, const char* data, size_t size )
+	{
+		return static_cast< BluetoothLink* >( link )->write( reinterpret_cast< const uint8_t* >( data ), size );
+	}
+
+
+	FILE* BluetoothLink::openFile( )
+	{
+		FILE* f = fopencookie( this, "r+", { readCookie, writeCookie, nullptr, nullptr } );
+		if ( f )
+			setvbuf( f, nullptr, _IONBF, 0 );
+		return f;
+	}
+
+
+	size_t BluetoothLink::write( const uint8_t* data, size_t size )
+	{
+		std::unique_lock < std::mutex > lock( _mutex );
+		size_t written = 0;
+		while ( written != size && _running ) {
+			size_t part = std::min( size - written, _config.txBuffer );
+			// wait until the part fits the transmit buffer
+			Clock::time_point blocked = Clock::now();
+			while ( _running ) {
+				Clock::time_point now = Clock::now();
+				int64_t backlogUs = std::chrono::duration_cast < std::chrono::microseconds >( _txDone - now ).count();
+				uint64_t backlog = backlogUs > 0 ? uint64_t( backlogUs ) * _config.bytesPerSecond / 1000000 : 0;
+				// bytes the PC side has not taken, beyond those still on the way
+				uint64_t inFlight = uint64_t( _config.bytesPerSecond ) * _config.latencyUs / 1000000;
+				if ( _queuedBytes > inFlight )
+					backlog = std::max( backlog, _queuedBytes - inFlight );
+				if ( backlog + part <= _config.txBuffer )
+					break;
+				uint64_t waitUs = ( backlog + part - _config.txBuffer ) * 1000000 / _config.bytesPerSecond + 1;
+				_wake.wait_for( lock, std::chrono::microseconds( waitUs ) );
+			}
+			Clock::time_point now = Clock::now();
+			_stats.blockedUs += std::chrono::duration_cast < std::chrono::microseconds >( now - blocked ).count();
+
+			_txDone = std::max( _txDone, now ) +
+			          std::chrono::microseconds( uint64_t( part ) * 1000000 / _config.bytesPerSecond );
+			_queue.push_back( { _txDone + std::chrono::microseconds( _config.latencyUs ),
+			                    std::vector < uint8_t >( data + written, data + written + part ) } );
+			_stream.decode( data + written, part, [ this ]( const atoms::AvakarView& v ) {
+				_stats.sentPackets[ v.command() ]++;
+			} );
+			_stats.sentBytes += part;
+			_queuedBytes += part;
+			written += part;
+			_wake.notify_all();
+		}
+		return written;
+	}
+
+
+	size_t BluetoothLink::read( uint8_t* data, size_t size )
+	{
+		_readers++;
+		size_t n = readSome( data, size );
+		_readers--;
+		return n;
+	}
+
+
+	size_t BluetoothLink::readSome( uint8_t* data, size_t size )
+	{
+		while ( _running ) {
+			pollfd p{ _master, POLLIN, 0 };
+			if ( poll( &p, 1, 100 ) <= 0 )
+				continue;
+			ssize_t n = ::read( _master, data, size );
+			if ( n > 0 ) {
+				std::lock_guard < std::mutex > lock( _mutex );
+				_stats.receivedBytes += n;
+				return n;
+			}
+			if ( n < 0 && errno != EAGAIN && errno != EINTR )
+				return 0;
+		}
+		return 0;
+	}
+
+
+	BluetoothLink::Stats BluetoothLink::stats( )
+	{
+		std::lock_guard < std::mutex > lock( _mutex );
+		return _stats;
+	}
+
+
+	void BluetoothLink::deliver( )
+	{
+		std::unique_lock < std::mutex > lock( _mutex );
+		while ( true ) {
+			if ( _queue.empty() ) {
+				if ( !_running )
+					return;
+				_wake.wait( lock );
+				continue;
+			}
+			// what is on the way when closing is delivered at once
+			if ( _running && Clock::now() < _queue.front().due ) {
+				_wake.wait_until( lock, _queue.front().due );
+				continue;
+			}
+			Chunk chunk = std::move( _queue.front() );
+			_queue.pop_front();
+			lock.unlock();
+
+			size_t pos = 0;
+			while ( pos != chunk.data.size() ) {
+				ssize_t n = ::write( _master, chunk.data.data() + pos, chunk.data.size() - pos );
+				if ( n > 0 ) {
+					pos += n;
+					continue;
+				}
+				if ( n < 0 && errno != EAGAIN && errno != EINTR )
+					break;
+				// nobody reads the other side and the terminal buffer is full
+				pollfd p{ _master, POLLOUT, 0 };
+				if ( poll( &p, 1, 100 ) == 0 && !_running )
+					break;
+			}
+			lock.lock();
+			_queuedBytes -= chunk.data.size();
+			_wake.notify_all();
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Stand-in for the Bluetooth serial port of the robot on a Linux host: a
+// pseudo-terminal which the tools on the PC side (Lorris, a terminal, a script)
+// open instead of the rfcomm device of the real robot.
+//
+// Data from the robot leaves at the bandwidth of the link and arrives after its
+// latency. A write blocks while more than txBuffer bytes wait for the link or for
+// the PC side to read them, like the EV3 serial driver does, so telemetry_task
+// stalls and the telemetry ring fills up as on the robot. The outgoing stream is
+// split into Avakar packets for the statistics.
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <atoms/communication/avakar_stream.h>
+
+
+namespace shim
+{
+	class BluetoothLink
+	{
+	public:
+		struct Config
+		{
+			uint32_t bytesPerSecond = 23040;   // SPP at 230400 Bd
+			uint32_t latencyUs = 20000;
+			size_t txBuffer = 1024;
+		};
+
+
+		struct Stats
+		{
+			uint64_t sentBytes = 0;
+			uint64_t sentPackets[ 16 ] = { };  // Avakar packets by command
+			uint64_t skippedBytes = 0;         // outside of Avakar packets
+			uint64_t receivedBytes = 0;
+			uint64_t blockedUs = 0;            // writers waiting for the link
+		};
+
+
+		explicit BluetoothLink( const Config& config );
+		~BluetoothLink( );
+
+		BluetoothLink( const BluetoothLink& ) = delete;
+		BluetoothLink& operator=( const BluetoothLink& ) = delete;
+
+		// Creates the pseudo-terminal and starts the delivery
+		bool open( std::string& error );
+		// Flushes what is on the way and stops
+		void close( );
+
+		// The device the PC side opens, e.g. /dev/pts/3
+		const std::string& path( ) const { return _path; }
+
+		// A new unbuffered FILE for reading and writing, as ev3_serial_open_file()
+		// gives on EV3RT; reading blocks until a byte comes or the link closes
+		FILE* openFile( );
+
+		size_t write( const uint8_t* data, size_t size );
+		// 0 once the link is closed
+		size_t read( uint8_t* data, size_t size );
+
+		Stats stats( );
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Chunk
+		{
+			Clock::time_point due;
+			std::vector < uint8_t > data;
+		};
+
+		void deliver( );
+		size_t readSome( uint8_t* data, size_t size );
+
+		Config _config;
+		std::string _path;
+		int _master;
+		int _slave;
+		std::atomic < bool > _running;
+		std::atomic < int > _readers;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::deque < Chunk > _queue;
+		uint64_t _queuedBytes;
+		// when the last queued byte has been serialized
+		Clock::time_point _txDone;
+		atoms::AvakarStream _stream;
+		Stats _stats;
+		std::thread _delivery;
+	};
+}
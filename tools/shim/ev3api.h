@@ -0,0 +1,38 @@
+#pragma once
+
+// Host stand-in for the EV3RT C API, see shim.cpp. Only what the firmware uses.
+
+#include <cstdint>
+#include <cstdio>
+#include <cassert>
+
+typedef int ER;
+typedef int ID;
+typedef int BOOL_T;
+typedef int PRI;
+typedef uint32_t RELTIM;
+typedef uint32_t SYSTIM;
+typedef uint64_t SYSUTM;
+
+#define E_OK 0
+#define TMIN_APP_TPRI 5
+
+enum { EV3_FONT_SMALL, EV3_FONT_MEDIUM };
+enum { EV3_SERIAL_DEFAULT, EV3_SERIAL_UART, EV3_SERIAL_BT };
+
+ER get_tim( SYSTIM* t );
+ER get_utm( SYSUTM* t );
+ER dly_tsk( RELTIM ms );
+ER tslp_tsk( RELTIM ms );
+ER slp_tsk( );
+ER wup_tsk( ID id );
+ER act_tsk( ID id );
+ER ter_tsk( ID id );
+ER ext_tsk( );
+ER loc_cpu( );
+ER unl_cpu( );
+
+void ev3_speaker_set_volume( int volume );
+void ev3_speaker_play_tone( unsigned frequency, int durationMs );
+FILE* ev3_serial_open_file( int port );
+bool ev3_bluetooth_is_connected( );
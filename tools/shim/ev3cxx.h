@@ -0,0 +1,222 @@
+#pragma once
+
+// Host stand-in for ev3cxx. The devices read and write shim::hardware, which the
+// host tools fill with recorded or simulated values; time is virtual and advances
+// only when the firmware sleeps, see shim.cpp.
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include "ev3api.h"
+
+namespace ev3cxx
+{
+	enum class SensorPort { S1, S2, S3, S4 };
+	enum class MotorPort { A, B, C, D };
+	enum class MotorType { LARGE, MEDIUM };
+	enum class BrickButtons { LEFT, RIGHT, UP, DOWN, ENTER, BACK };
+	enum class StatusLightColor { OFF, RED, GREEN, ORANGE };
+}
+
+
+namespace shim
+{
+	struct Hardware
+	{
+		int32_t encoder[ 4 ] = { };        // by MotorPort
+		int power[ 4 ] = { };
+		int reflected[ 4 ] = { };          // by SensorPort
+		bool touch[ 4 ] = { };
+		int distanceCm[ 4 ] = { 255, 255, 255, 255 };
+		bool button[ 6 ] = { };            // by BrickButtons
+		ev3cxx::StatusLightColor light = ev3cxx::StatusLightColor::OFF;
+
+		// Called before the virtual time advances to toUs, e.g. to feed recorded data.
+		// It may move the time forward in smaller steps by setTimeUs().
+		std::function < void( uint64_t toUs ) > onSleep;
+		// MotorTank commands: 0 on, 1 off, 2 brake, and both powers
+		std::function < void( int action, int a, int b ) > onTank;
+		// Bytes written through ev3cxx::Bluetooth
+		std::function < void( char c ) > onBluetooth;
+		// Called by ev3_serial_open_file( EV3_SERIAL_BT ), e.g. BluetoothLink::openFile
+		std::function < FILE*( ) > openBluetooth;
+		bool bluetoothConnected = false;
+	};
+
+
+	extern Hardware hardware;
+
+	uint64_t timeUs( );
+	void setTimeUs( uint64_t t );
+	// Sleeps follow the wall clock as well, for tools talking to the outside world
+	void setRealTime( bool on );
+}
+
+
+namespace ev3cxx
+{
+	inline void delayMs( unsigned ms )
+	{
+		dly_tsk( ms );
+	}
+
+
+	struct StatusLight
+	{
+		void setColor( StatusLightColor c )
+		{
+			shim::hardware.light = c;
+		}
+	};
+
+
+	extern StatusLight statusLight;
+
+
+	struct Motor
+	{
+		Motor( MotorPort port, MotorType = MotorType::LARGE ) : port( static_cast< int >( port ) ) { }
+
+		void on( int power ) { shim::hardware.power[ port ] = power; }
+		void off( bool = true ) { shim::hardware.power[ port ] = 0; }
+		int degrees( ) { return shim::hardware.encoder[ port ]; }
+		void resetPosition( ) { shim::hardware.encoder[ port ] = 0; }
+		int currentPower( ) { return shim::hardware.power[ port ]; }
+
+		int port;
+	};
+
+
+	struct MotorTank
+	{
+		MotorTank( MotorPort left, MotorPort right ) : left( left ), right( right ) { }
+
+		void on( int a, int b )
+		{
+			left.on( a );
+			right.on( b );
+			if ( shim::hardware.onTank )
+				shim::hardware.onTank( 0, a, b );
+		}
+
+		void off( bool brake = true )
+		{
+			left.off( brake );
+			right.off( brake );
+			if ( shim::hardware.onTank )
+				shim::hardware.onTank( brake ? 2 : 1, 0, 0 );
+		}
+
+		// Only for DifferentialDrive, which the control code does not use; the
+		// encoders do not move on the host
+		void onForDegrees( int a, int b, int, bool brake = true, bool blocking = true, unsigned = 60 )
+		{
+			on( a, b );
+			if ( blocking )
+				off( brake );
+		}
+
+		Motor& leftMotor( ) { return left; }
+		Motor& rightMotor( ) { return right; }
+
+		Motor left;
+		Motor right;
+	};
+
+
+	struct ColorSensor
+	{
+		ColorSensor( SensorPort port ) : port( static_cast< int >( port ) ) { }
+
+		int reflected( bool = true, bool = true ) { return shim::hardware.reflected[ port ]; }
+
+		int port;
+	};
+
+
+	struct TouchSensor
+	{
+		TouchSensor( SensorPort port ) : port( static_cast< int >( port ) ) { }
+
+		bool isPressed( ) { return shim::hardware.touch[ port ]; }
+
+		int port;
+	};
+
+
+	struct UltrasonicSensor
+	{
+		UltrasonicSensor( SensorPort port ) : port( static_cast< int >( port ) ) { }
+
+		int centimeters( ) { return shim::hardware.distanceCm[ port ]; }
+		int millimeters( ) { return shim::hardware.distanceCm[ port ] * 10; }
+
+		int port;
+	};
+
+
+	struct BrickButton
+	{
+		BrickButton( BrickButtons b ) : button( static_cast< int >( b ) ) { }
+
+		bool isPressed( ) { return shim::hardware.button[ button ]; }
+
+		int button;
+	};
+
+
+	struct Bluetooth
+	{
+		Bluetooth( bool = true ) { }
+
+		void write( char c )
+		{
+			if ( shim::hardware.onBluetooth )
+				shim::hardware.onBluetooth( c );
+		}
+
+		bool isConnected( ) { return shim::hardware.bluetoothConnected; }
+	};
+
+
+	struct StopWatch
+	{
+		StopWatch( ) { reset(); }
+
+		void reset( ) { start = shim::timeUs(); }
+		unsigned getUs( ) { return static_cast< unsigned >( shim::timeUs() - start ); }
+		unsigned getMs( ) { return getUs() / 1000; }
+
+		uint64_t start;
+	};
+
+
+	namespace detail
+	{
+		struct Formatter
+		{
+			template < typename T >
+			Formatter& operator%( const T& ) { return *this; }
+		};
+
+
+		struct Display
+		{
+			void write( char ) { }
+			Formatter format( const char* ) { return { }; }
+			void resetScreen( ) { }
+			void setFont( int ) { }
+		};
+	}
+
+
+	extern detail::Display display;
+
+
+	template < typename T >
+	detail::Formatter format( T&, const char* )
+	{
+		return { };
+	}
+}
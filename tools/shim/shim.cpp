@@ -0,0 +1,109 @@
+#include <chrono>
+#include <thread>
+
+#include "ev3cxx.h"
+
+
+namespace shim
+{
+	Hardware hardware;
+
+	static uint64_t now = 0;
+
+
+	uint64_t timeUs( )
+	{
+		return now;
+	}
+
+
+	void setTimeUs( uint64_t t )
+	{
+		if ( t > now )
+			now = t;
+	}
+
+
+	static bool realTime = false;
+	static std::chrono::steady_clock::time_point wallStart;
+	static uint64_t virtualStart;
+
+
+	void setRealTime( bool on )
+	{
+		realTime = on;
+		wallStart = std::chrono::steady_clock::now();
+		virtualStart = now;
+	}
+
+
+	static void waitForWallClock( )
+	{
+		if ( realTime )
+			std::this_thread::sleep_until( wallStart + std::chrono::microseconds( now - virtualStart ) );
+	}
+}
+
+
+namespace ev3cxx
+{
+	StatusLight statusLight;
+	detail::Display display;
+}
+
+
+ER get_tim( SYSTIM* t )
+{
+	*t = static_cast< SYSTIM >( shim::timeUs() / 1000 );
+	return E_OK;
+}
+
+
+ER get_utm( SYSUTM* t )
+{
+	*t = shim::timeUs();
+	return E_OK;
+}
+
+
+// There are no other tasks, a sleep only moves the virtual time
+ER dly_tsk( RELTIM ms )
+{
+	uint64_t to = shim::timeUs() + uint64_t( ms ) * 1000;
+	if ( shim::hardware.onSleep )
+		shim::hardware.onSleep( to );
+	shim::setTimeUs( to );
+	shim::waitForWallClock();
+	return E_OK;
+}
+
+
+ER tslp_tsk( RELTIM ms )
+{
+	return dly_tsk( ms );
+}
+
+
+ER slp_tsk( ) { return E_OK; }
+ER wup_tsk( ID ) { return E_OK; }
+ER act_tsk( ID ) { return E_OK; }
+ER ter_tsk( ID ) { return E_OK; }
+ER ext_tsk( ) { return E_OK; }
+ER loc_cpu( ) { return E_OK; }
+ER unl_cpu( ) { return E_OK; }
+
+
+void ev3_speaker_set_volume( int ) { }
+void ev3_speaker_play_tone( unsigned, int ) { }
+
+
+FILE* ev3_serial_open_file( int port )
+{
+	return port == EV3_SERIAL_BT && shim::hardware.openBluetooth ? shim::hardware.openBluetooth() : nullptr;
+}
+
+
+bool ev3_bluetooth_is_connected( )
+{
+	return shim::hardware.bluetoothConnected;
+}